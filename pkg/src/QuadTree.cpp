@@ -14,10 +14,14 @@
 // Originally written for package lidR by Jean-Romain Roussel
 // Author: Jean-Romain Roussel
 // 3 may 2017: copy from package lidR to package geometry by Jean-Romain Roussel to operate in fast tsearch funtion
+// 18 oct 2026: rewrite as a linear quadtree with points in Morton order and adaptive depth
+//              index the coordinates in place rather than copying them
 
 #include "QuadTree.h"
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <utility>
 
 Point::Point(){}
 Point::Point(const double x, const double y) : x(x), y(y), id(0) {}
@@ -51,174 +55,263 @@ bool BoundingBox::intersects(const BoundingBox& b)
     return false;
 }
 
-QuadTree::QuadTree(const BoundingBox boundary, const int parent_depth, const double eps)
+QuadTree::QuadTree(const double* x, const double* y, const double xoffset, const double yoffset, const int leaf_size, const int max_depth, const double eps) :
+  x(x), y(y), xoffset(xoffset), yoffset(yoffset)
 {
-  MAX_DEPTH = 6;
+  LEAF_SIZE = leaf_size < 1 ? 1 : leaf_size;
+  MAX_DEPTH = max_depth < 0 ? 0 : (max_depth > 32 ? 32 : max_depth);
   EPSILON = eps;
-
-  depth = parent_depth + 1;
-  this->boundary = boundary;
-
-  NE = 0;
-  NW = 0;
-  SE = 0;
-  SW = 0;
 }
 
 QuadTree::~QuadTree()
 {
-  delete NE;
-  delete NW;
-  delete SE;
-  delete SW;
 }
 
-QuadTree* QuadTree::create(const std::vector<double>& x, const std::vector<double>& y, const double eps = 1.0e-12)
+// Spread the lower 32 bits of v out to the even bits of the result
+static inline unsigned long long spread_bits(unsigned long long v)
 {
-  int n = x.size();
-
-  double xmin = x[0];
-  double ymin = y[0];
-  double xmax = x[0];
-  double ymax = y[0];
+  v &= 0xFFFFFFFFULL;
+  v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+  v = (v | (v << 8))  & 0x00FF00FF00FF00FFULL;
+  v = (v | (v << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+  v = (v | (v << 2))  & 0x3333333333333333ULL;
+  v = (v | (v << 1))  & 0x5555555555555555ULL;
+  return v;
+}
 
-  for(int i = 0 ; i < n ; i++)
-  {
-    if(x[i] < xmin)
-      xmin = x[i];
-    else if(x[i] > xmax)
-      xmax = x[i];
-
-    if(y[i] < ymin)
-      ymin = y[i];
-    else if(y[i] > ymax)
-      ymax = y[i];
-  }
+// Index the n points (x[ids[i]] - xoffset, y[ids[i]] - yoffset), or
+// the points (x[i] - xoffset, y[i] - yoffset) if ids is NULL. The
+// coordinates are not copied, so x and y must outlive the tree.
+QuadTree* QuadTree::create(const double* x, const double* y, const int n, const int* ids, const double xoffset, const double yoffset, const double eps, const int leaf_size, const int max_depth)
+{
+  QuadTree *tree = new QuadTree(x, y, xoffset, yoffset, leaf_size, max_depth, eps);
 
-  double xrange = xmax - xmin;
-  double yrange = ymax - ymin;
-  double range = xrange > yrange ? xrange/2 : yrange/2;
+  if (n == 0)
+    return tree;
 
-  Point bcenter((xmin+xmax)/2, (ymin+ymax)/2);
-  Point brange(range, range);
-  BoundingBox bbox(bcenter, brange);
+  tree->index.resize(n);
+  for(int i = 0 ; i < n ; i++)
+    tree->index[i] = ids ? ids[i] : i;
 
-  QuadTree *tree = new QuadTree(bbox, 0, eps);
+  Point p = tree->point(0);
+  double xmin = p.x;
+  double ymin = p.y;
+  double xmax = p.x;
+  double ymax = p.y;
 
   for(int i = 0 ; i < n ; i++)
   {
-    Point p(x[i], y[i], i);
+    p = tree->point(i);
 
-    if (!tree->insert(p))
+    // Points that cannot be placed in the tree, e.g. NA
+    if (!std::isfinite(p.x) || !std::isfinite(p.y))
     {
       delete tree;
       return nullptr;
     }
+
+    if(p.x < xmin)
+      xmin = p.x;
+    else if(p.x > xmax)
+      xmax = p.x;
+
+    if(p.y < ymin)
+      ymin = p.y;
+    else if(p.y > ymax)
+      ymax = p.y;
   }
 
-  return tree;
-}
+  double xrange = xmax - xmin;
+  double yrange = ymax - ymin;
+  double range = xrange > yrange ? xrange : yrange;
+  double scale = range > 0 ? 4294967295.0/range : 0;
 
-bool QuadTree::insert(const Point& p)
-{
-  if(!boundary.contains(p, EPSILON))
-    return false;
+  // Sort the points by Morton code
+  std::vector< std::pair<unsigned long long, int> > order(n);
 
-  if(depth == MAX_DEPTH)
+  for(int i = 0 ; i < n ; i++)
   {
-    points.push_back(p);
-    return true;
+    p = tree->point(i);
+    unsigned long long qx = (unsigned long long)((p.x - xmin)*scale);
+    unsigned long long qy = (unsigned long long)((p.y - ymin)*scale);
+    order[i] = std::make_pair(spread_bits(qx) | (spread_bits(qy) << 1), tree->index[i]);
   }
 
-  if(NW == 0)
-    subdivide();
+  std::sort(order.begin(), order.end());
 
-  if(NW->insert(p))
-    return true;
-  if(NE->insert(p))
-    return true;
-  if(SW->insert(p))
-    return true;
-  if(SE->insert(p))
-    return true;
+  std::vector<unsigned long long> codes(n);
 
-  return false;
-}
+  for(int i = 0 ; i < n ; i++)
+  {
+    codes[i] = order[i].first;
+    tree->index[i] = order[i].second;
+  }
 
-void QuadTree::subdivide()
-{
-  double half_res_half = boundary.half_res.x * 0.5;
-
-  Point p(half_res_half, half_res_half);
-  Point pNE(boundary.center.x + half_res_half, boundary.center.y + half_res_half);
-  Point pNW(boundary.center.x - half_res_half, boundary.center.y + half_res_half);
-  Point pSE(boundary.center.x + half_res_half, boundary.center.y - half_res_half);
-  Point pSW(boundary.center.x - half_res_half, boundary.center.y - half_res_half);
-
-  NE = new QuadTree(BoundingBox(pNE, p), depth, EPSILON);
-  NW = new QuadTree(BoundingBox(pNW, p), depth, EPSILON);
-  SE = new QuadTree(BoundingBox(pSE, p), depth, EPSILON);
-  SW = new QuadTree(BoundingBox(pSW, p), depth, EPSILON);
+  std::vector< std::pair<unsigned long long, int> >().swap(order);
+
+  Node root;
+  root.begin = 0;
+  root.end = n;
+  tree->nodes.push_back(root);
+  tree->build(0, 0, codes);
+
+  return tree;
 }
 
-void QuadTree::range_lookup(const BoundingBox bb, std::vector<Point*>& res, const int method)
+// Split node into its non-empty quadrants, which are contiguous
+// ranges of the points sorted by Morton code, and compute the
+// bounding boxes from the bottom up
+void QuadTree::build(const int node, const int depth, const std::vector<unsigned long long>& codes)
 {
-  if(!boundary.intersects(bb))
-    return;
+  int begin = nodes[node].begin;
+  int end = nodes[node].end;
+
+  nodes[node].child = -1;
+  nodes[node].nchild = 0;
 
-  if(depth == MAX_DEPTH)
+  if (end - begin <= LEAF_SIZE || depth >= MAX_DEPTH)
   {
-    switch(method)
+    Point p = point(begin);
+    nodes[node].xmin = nodes[node].xmax = p.x;
+    nodes[node].ymin = nodes[node].ymax = p.y;
+
+    for (int i = begin + 1 ; i < end ; i++)
     {
-    case 1: getPointsSquare(bb, points, res);
-      break;
+      p = point(i);
+      nodes[node].xmin = std::min(nodes[node].xmin, p.x);
+      nodes[node].xmax = std::max(nodes[node].xmax, p.x);
+      nodes[node].ymin = std::min(nodes[node].ymin, p.y);
+      nodes[node].ymax = std::max(nodes[node].ymax, p.y);
+    }
+    return;
+  }
 
-    case 2: getPointsCircle(bb, points, res);
-      break;
+  // The quadrant at this depth is given by two bits of the code
+  int shift = 2*(31 - depth);
+  unsigned long long prefix = (codes[begin] >> (shift + 2)) << (shift + 2);
+
+  int bounds[5];
+  bounds[0] = begin;
+  bounds[4] = end;
+  for (int q = 1 ; q < 4 ; q++)
+  {
+    unsigned long long first = prefix | ((unsigned long long)q << shift);
+    bounds[q] = std::lower_bound(codes.begin() + begin, codes.begin() + end, first) - codes.begin();
+  }
+
+  int child = nodes.size();
+  int nchild = 0;
+
+  for (int q = 0 ; q < 4 ; q++)
+  {
+    if (bounds[q + 1] > bounds[q])
+    {
+      Node n;
+      n.begin = bounds[q];
+      n.end = bounds[q + 1];
+      nodes.push_back(n);
+      nchild++;
     }
   }
 
-  if(NW == 0)
+  // All the points are in the same quadrant
+  if (nchild == 1)
+  {
+    nodes.pop_back();
+    build(node, depth + 1, codes);
     return;
+  }
 
-  NE->range_lookup(bb, res, method);
-  NW->range_lookup(bb, res, method);
-  SE->range_lookup(bb, res, method);
-  SW->range_lookup(bb, res, method);
+  nodes[node].child = child;
+  nodes[node].nchild = nchild;
 
-  return;
+  for (int c = child ; c < child + nchild ; c++)
+    build(c, depth + 1, codes);
+
+  nodes[node].xmin = nodes[child].xmin;
+  nodes[node].xmax = nodes[child].xmax;
+  nodes[node].ymin = nodes[child].ymin;
+  nodes[node].ymax = nodes[child].ymax;
+
+  for (int c = child + 1 ; c < child + nchild ; c++)
+  {
+    nodes[node].xmin = std::min(nodes[node].xmin, nodes[c].xmin);
+    nodes[node].xmax = std::max(nodes[node].xmax, nodes[c].xmax);
+    nodes[node].ymin = std::min(nodes[node].ymin, nodes[c].ymin);
+    nodes[node].ymax = std::max(nodes[node].ymax, nodes[c].ymax);
+  }
 }
 
-void QuadTree::rect_lookup(const double xc, const double yc, const double half_width, const double half_height, std::vector<Point*>& res)
+void QuadTree::range_lookup(const BoundingBox bb, std::vector<int>& res, const int method)
 {
-  range_lookup(BoundingBox(Point(xc, yc), Point(half_width, half_height)), res, 1);
-  return;
-}
+  if (nodes.empty())
+    return;
 
+  // Depth-first traversal. At most three siblings are waiting at each
+  // level, so the stack cannot overflow.
+  int stack[4*32 + 4];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0)
+  {
+    const Node& node = nodes[stack[--top]];
+
+    // The tests are written as in in_rect() so that no point that
+    // in_rect() would accept is missed because of rounding
+    if (bb.center.x - node.xmin < -bb.half_res.x ||
+        bb.center.x - node.xmax > bb.half_res.x ||
+        bb.center.y - node.ymin < -bb.half_res.y ||
+        bb.center.y - node.ymax > bb.half_res.y)
+      continue;
+
+    // If opposite corners of the node are in the rectangle, all of the
+    // points in it are, so they can be added without testing them
+    if (method == 1 &&
+        in_rect(bb, Point(node.xmin, node.ymin)) &&
+        in_rect(bb, Point(node.xmax, node.ymax)))
+    {
+      res.insert(res.end(), index.begin() + node.begin, index.begin() + node.end);
+      continue;
+    }
+
+    if (node.child >= 0)
+    {
+      for (int c = node.child + node.nchild - 1 ; c >= node.child ; c--)
+        stack[top++] = c;
+      continue;
+    }
+
+    for (int i = node.begin ; i < node.end ; i++)
+    {
+      switch(method)
+      {
+      case 1:
+        if (in_rect(bb, point(i)))
+          res.push_back(index[i]);
+        break;
+
+      case 2:
+        if (in_circle(bb.center, point(i), bb.half_res.x))
+          res.push_back(index[i]);
+        break;
+      }
+    }
+  }
 
-void QuadTree::circle_lookup(const double cx, const double cy, const double range, std::vector<Point*>& res)
-{
-  range_lookup(BoundingBox(Point(cx, cy), Point(range, range)), res, 2);
   return;
 }
 
-void QuadTree::getPointsSquare(const BoundingBox bb, std::vector<Point>& points, std::vector<Point*>& res)
+void QuadTree::rect_lookup(const double xc, const double yc, const double half_width, const double half_height, std::vector<int>& res)
 {
-  for(std::vector<Point>::iterator it = points.begin(); it != points.end(); it++)
-  {
-    if(in_rect(bb, *it))
-      res.push_back(&(*it));
-  }
+  range_lookup(BoundingBox(Point(xc, yc), Point(half_width, half_height)), res, 1);
   return;
 }
 
-void QuadTree::getPointsCircle(const BoundingBox bb, std::vector<Point>& points, std::vector<Point*>& res)
+
+void QuadTree::circle_lookup(const double cx, const double cy, const double range, std::vector<int>& res)
 {
-  for(std::vector<Point>::iterator it = points.begin(); it != points.end(); it++)
-  {
-    if(in_circle(bb.center, (*it), bb.half_res.x))
-      res.push_back(&(*it));
-  }
+  range_lookup(BoundingBox(Point(cx, cy), Point(range, range)), res, 2);
   return;
 }
 
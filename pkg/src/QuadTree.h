@@ -14,12 +14,20 @@
 // Originally written for package lidR by Jean-Romain Roussel
 // Author: Jean-Romain Roussel
 // 3 may 2017: copy from package lidR to package geometry by Jean-Romain Roussel to operate in fast tsearch funtion
+// 18 oct 2026: rewrite as a linear quadtree with points in Morton order and adaptive depth
+//              index the coordinates in place rather than copying them
 
 #ifndef QT_H
 #define QT_H
 
 #include <vector>
 
+// Default number of points in a leaf before it is split, and maximum
+// depth of the tree. Points are located to 32 bits in each direction,
+// so the depth can be at most 32.
+#define QT_LEAF_SIZE 32
+#define QT_MAX_DEPTH 32
+
 struct Point
 {
   double x, y;
@@ -40,33 +48,49 @@ struct BoundingBox
   bool intersects(const BoundingBox&);
 };
 
+// The tree indexes coordinates held elsewhere, e.g. in R vectors,
+// without copying them. The points are shifted by an offset when they
+// are compared, and lookups return the indices of the points. The
+// indices are stored in a single array sorted by the Morton (Z-order)
+// codes of the points, so that the points in each node of the tree
+// are a contiguous range of the array. Nodes are stored in a single
+// array too, with the children of a node next to each other. A node
+// is split only if it holds more than leaf_size points, so the depth
+// of the tree adapts to the density of the points.
 class QuadTree
 {
 public:
   ~QuadTree();
-  static QuadTree* create(const std::vector<double>&, const std::vector<double>&, const double eps);
-  bool insert(const Point&);
-  void rect_lookup(const double, const double, const double, const double, std::vector<Point*>&);
-  void circle_lookup(const double, const double, const double, std::vector<Point*>&);
+  static QuadTree* create(const double*, const double*, const int, const int*, const double, const double, const double eps, const int leaf_size = QT_LEAF_SIZE, const int max_depth = QT_MAX_DEPTH);
+  void rect_lookup(const double, const double, const double, const double, std::vector<int>&);
+  void circle_lookup(const double, const double, const double, std::vector<int>&);
 
 
 private:
+  struct Node
+  {
+    // Bounding box of the points in the node
+    double xmin, xmax, ymin, ymax;
+    // The points in the node are index[begin] ... index[end - 1]
+    int begin, end;
+    // The children are nodes[child] ... nodes[child + nchild - 1], or
+    // child is -1 for a leaf
+    int child, nchild;
+  };
+
   int MAX_DEPTH;
+  int LEAF_SIZE;
   double EPSILON;
-  int depth;
-  BoundingBox boundary;
-  std::vector<Point> points;
-  QuadTree* NE;
-  QuadTree* NW;
-  QuadTree* SE;
-  QuadTree* SW;
+  const double *x, *y;
+  double xoffset, yoffset;
+  std::vector<int> index;
+  std::vector<Node> nodes;
 
-  QuadTree(const BoundingBox, const int, const double);
+  QuadTree(const double*, const double*, const double, const double, const int, const int, const double);
 
-  void subdivide();
-  void range_lookup(const BoundingBox, std::vector<Point*>&, const int);
-  void getPointsSquare(const BoundingBox, std::vector<Point>&, std::vector<Point*>&);
-  void getPointsCircle(const BoundingBox, std::vector<Point>&, std::vector<Point*>&);
+  Point point(const int i) const { return Point(x[index[i]] - xoffset, y[index[i]] - yoffset, index[i]); }
+  void build(const int, const int, const std::vector<unsigned long long>&);
+  void range_lookup(const BoundingBox, std::vector<int>&, const int);
   bool in_circle(const Point&, const Point&, const double);
   bool in_rect(const BoundingBox&, const Point&);
 };
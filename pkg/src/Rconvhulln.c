@@ -27,11 +27,24 @@
 * Changed the interface for R
 
 02. February 2018 - Pavlo Mozharovskyi: added non-triangulated output
+
+18. October 2026: added C_convhulln_batch() for the hulls of many
+groups of points
+
+18. October 2026: added keepQhull argument to free the hull when
+it is not needed for inhulln()
+
+18. October 2026: added C_convhulln_index() to extract a flat,
+serialisable index of the hull
+
+18. October 2026: added incremental hulls, to which points are added
+with qh_addpoint()
 */
 
 #include "Rgeometry.h"
 
-SEXP C_convhulln(const SEXP p, const SEXP options, const SEXP returnNonTriangulatedFacets, const SEXP tmp_stdout, const SEXP tmp_stderr)
+SEXP C_convhulln(const SEXP p, const SEXP options, const SEXP returnNonTriangulatedFacets, const SEXP transposed, const SEXP spatialSort,
+                 const SEXP keepQhull)
 {
   /* Initialise return values */
   SEXP retval, area, vol, normals, retlist, retnames;
@@ -42,7 +55,9 @@ SEXP C_convhulln(const SEXP p, const SEXP options, const SEXP returnNonTriangula
   char errstr[ERRSTRSIZE];
   unsigned int dim, n;
   char cmd[50] = "qhull";
-  int exitcode = qhullNewQhull(qh, p, cmd,  options, tmp_stdout, tmp_stderr, &dim, &n, errstr);
+  int *order = NULL;
+  int exitcode = qhullNewQhull(qh, p, cmd,  options, Rf_asLogical(transposed) == TRUE,
+                               Rf_asLogical(spatialSort) == TRUE ? &order : NULL, &dim, &n, errstr);
 
   /* Error handling */
   if (exitcode) {
@@ -95,9 +110,9 @@ SEXP C_convhulln(const SEXP p, const SEXP options, const SEXP returnNonTriangula
       /* qh_printvertex(stdout,vertex); */
       if (INTEGER(returnNonTriangulatedFacets)[0] == 0 && j >= dim)
         Rf_warning("extra vertex %d of facet %d = %d",
-                j++, i, 1+qh_pointid(qh, vertex->point));
+                j++, i, 1 + qhullPointRow(order, qh_pointid(qh, vertex->point)));
       else
-        idx[i + nf*j++] = 1 + qh_pointid(qh, vertex->point);
+        idx[i + nf*j++] = 1 + qhullPointRow(order, qh_pointid(qh, vertex->point));
     }
     if (j < dim) Rf_warning("facet %d only has %d vertices",i,j);
     while (j < nVertexMax){
@@ -155,12 +170,21 @@ SEXP C_convhulln(const SEXP p, const SEXP options, const SEXP returnNonTriangula
   SET_VECTOR_ELT(retnames, 3, Rf_mkChar("normals"));
   Rf_setAttrib(retlist, R_NamesSymbol, retnames);
 
+  /* If the hull is not to be kept, free it now rather than leaving
+     it to the garbage collector */
+  if (Rf_asLogical(keepQhull) != TRUE) {
+    freeQhull(qh);
+    UNPROTECT(6); /* retnames, retlist, normals, vol, area, retval */
+    return retlist;
+  }
+
   /* Register qhullFinalizer() for garbage collection and attach a
      pointer to the hull as an attribute for future use. */
   SEXP ptr, tag;
   tag = PROTECT(Rf_allocVector(STRSXP, 1));
   SET_STRING_ELT(tag, 0, Rf_mkChar("convhulln"));
-  ptr = PROTECT(R_MakeExternalPtr(qh, tag, R_NilValue));
+  /* If p has not been copied, the hull refers to it, so keep it alive */
+  ptr = PROTECT(R_MakeExternalPtr(qh, tag, Rf_asLogical(transposed) == TRUE ? p : R_NilValue));
   R_RegisterCFinalizerEx(ptr, qhullFinalizer, TRUE);
   Rf_setAttrib(retlist, tag, ptr);
 
@@ -168,3 +192,626 @@ SEXP C_convhulln(const SEXP p, const SEXP options, const SEXP returnNonTriangula
 
   return retlist;
 }
+
+/* Extract a flat representation of the hull pointed to by ptr, as
+   attached by C_convhulln(), for use by C_inhulln_index(). The facets
+   are in the same order as the rows of the hull returned by
+   C_convhulln(). Returns a list comprising the (dim+1)-by-nf matrix
+   planes, in which column i contains the normal and offset of facet
+   i, the nf-by-k integer matrix neighbours of the 1-based indices of
+   the neighbours of each facet, padded with NA, and the distance
+   tolerance above which Qhull considers a point to be outside a
+   facet and a point inside the hull. For simplicial facets,
+   neighbour j is opposite vertex j of the facet. */
+SEXP C_convhulln_index(const SEXP ptr)
+{
+  if (TYPEOF(ptr) != EXTPTRSXP) {
+    Rf_error("Convex hull has no convhulln attribute");
+  }
+  qhT *qh = R_ExternalPtrAddr(ptr);
+  if (qh == NULL) {
+    Rf_error("Qhull structure of convex hull is no longer available");
+  }
+
+  facetT *facet, *neighbor, **neighborp;
+  int dim = qh->hull_dim, nf = qh->num_facets, nnmax = 0, i, j;
+  int *rowmap = (int *) R_alloc(qh->facet_id + 1, sizeof(int));
+  i = 0;
+  FORALLfacets {
+    rowmap[facet->id] = ++i;
+    j = qh_setsize(qh, facet->neighbors);
+    if (j > nnmax)
+      nnmax = j;
+  }
+
+  SEXP planes, neighbours, interior, retlist, retnames;
+  planes = PROTECT(Rf_allocMatrix(REALSXP, dim + 1, nf));
+  neighbours = PROTECT(Rf_allocMatrix(INTSXP, nf, nnmax));
+  double *pl = REAL(planes);
+  int *nb = INTEGER(neighbours);
+  i = 0;
+  FORALLfacets {
+    for (j = 0; j < dim; j++)
+      pl[(size_t)(dim + 1)*i + j] = facet->normal ? facet->normal[j] : 0;
+    pl[(size_t)(dim + 1)*i + dim] = facet->normal ? facet->offset : 0;
+    j = 0;
+    FOREACHneighbor_(facet) {
+      nb[i + (size_t)nf*j++] = rowmap[neighbor->id];
+    }
+    while (j < nnmax)
+      nb[i + (size_t)nf*j++] = NA_INTEGER;
+    i++;
+  }
+
+  interior = PROTECT(Rf_allocVector(REALSXP, dim));
+  for (j = 0; j < dim; j++)
+    REAL(interior)[j] = qh->interior_point ? qh->interior_point[j] : 0;
+
+  retlist = PROTECT(Rf_allocVector(VECSXP, 4));
+  retnames = PROTECT(Rf_allocVector(STRSXP, 4));
+  SET_VECTOR_ELT(retlist, 0, planes);
+  SET_STRING_ELT(retnames, 0, Rf_mkChar("planes"));
+  SET_VECTOR_ELT(retlist, 1, neighbours);
+  SET_STRING_ELT(retnames, 1, Rf_mkChar("neighbours"));
+  SET_VECTOR_ELT(retlist, 2, Rf_ScalarReal(qh->MINoutside));
+  SET_STRING_ELT(retnames, 2, Rf_mkChar("tolerance"));
+  SET_VECTOR_ELT(retlist, 3, interior);
+  SET_STRING_ELT(retnames, 3, Rf_mkChar("interior"));
+  Rf_setAttrib(retlist, R_NamesSymbol, retnames);
+  UNPROTECT(5);
+
+  return retlist;
+}
+
+/* Extract the facets, area and volume of the hull of one group of
+   points in C_convhulln_batch() */
+static void convhullnBatchExtract(qhT *qh, int exitcode, int g, const int *rows, int n, int dim, void *data, qhullBatchT *res)
+{
+  if (exitcode)
+    return;
+  facetT *facet;
+  vertexT *vertex, **vertexp;
+  res->facets = (int *) malloc(((size_t) qh->num_facets*dim + 1)*sizeof(int));
+  if (!res->facets) {
+    res->exitcode = qh_ERRmem;
+    return;
+  }
+  int i = 0, j;
+  FORALLfacets {
+    j = 0;
+    FOREACHvertex_ (facet->vertices) {
+      if (j < dim)
+        res->facets[dim*i + j++] = 1 + rows[qh_pointid(qh, vertex->point)];
+    }
+    while (j < dim)
+      res->facets[dim*i + j++] = NA_INTEGER;
+    i++;
+  }
+  res->nf = i;
+  res->area = qh->totarea;
+  res->vol = qh->totvol;
+}
+
+/* Compute the convex hulls of groups of the points in the rows of
+   p. The rows of group g are rows[offsets[g]], ...,
+   rows[offsets[g + 1] - 1] (0-based). Returns the facets of all the
+   hulls as one matrix of 1-based row indices into p, the offsets of
+   each group's facets in this matrix, and the area, volume and Qhull
+   exit code of each hull. */
+SEXP C_convhulln_batch(const SEXP p, const SEXP rows, const SEXP offsets, const SEXP options, const SEXP nthreads)
+{
+  if(!Rf_isMatrix(p) || !Rf_isReal(p)){
+    Rf_error("First argument should be a real matrix.");
+  }
+  if(!Rf_isString(options) || Rf_length(options) != 1){
+    Rf_error("Options must be a single string.");
+  }
+  if (LENGTH(STRING_ELT(options, 0)) > 200)
+    Rf_error("Option string too long");
+
+  const int dim = Rf_ncols(p);
+  const int ng = Rf_length(offsets) - 1;
+  char flags[250];
+  snprintf(flags, 249, "qhull %s", CHAR(STRING_ELT(options, 0)));
+
+  qhullBatchT *res = (qhullBatchT *) R_alloc(ng, sizeof(qhullBatchT));
+  char errstr[ERRSTRSIZE];
+  if (qhullBatch(REAL(p), Rf_nrows(p), dim, INTEGER(rows), INTEGER(offsets), ng,
+                 flags, NULL, INTEGER(nthreads)[0], convhullnBatchExtract, NULL, res, errstr))
+    Rf_error("Interrupted");
+
+  /* Append the areas and volumes to the facets and offsets */
+  SEXP batch, area, vol, retlist, retnames;
+  area = PROTECT(Rf_allocVector(REALSXP, ng));
+  vol = PROTECT(Rf_allocVector(REALSXP, ng));
+  for (int g = 0; g < ng; g++) {
+    REAL(area)[g] = res[g].exitcode ? NA_REAL : res[g].area;
+    REAL(vol)[g] = res[g].exitcode ? NA_REAL : res[g].vol;
+  }
+  batch = PROTECT(qhullBatchResult(res, ng, dim, "hull", errstr));
+  retlist = PROTECT(Rf_allocVector(VECSXP, 6));
+  retnames = PROTECT(Rf_allocVector(STRSXP, 6));
+  for (int i = 0; i < 4; i++) {
+    SET_VECTOR_ELT(retlist, i, VECTOR_ELT(batch, i));
+    SET_STRING_ELT(retnames, i, STRING_ELT(Rf_getAttrib(batch, R_NamesSymbol), i));
+  }
+  SET_VECTOR_ELT(retlist, 4, area);
+  SET_STRING_ELT(retnames, 4, Rf_mkChar("area"));
+  SET_VECTOR_ELT(retlist, 5, vol);
+  SET_STRING_ELT(retnames, 5, Rf_mkChar("vol"));
+  Rf_setAttrib(retlist, R_NamesSymbol, retnames);
+  UNPROTECT(5);
+
+  return retlist;
+}
+
+/* Incremental convex hulls. Qhull refers to the points of the hull
+   rather than copying them, so they are held in memory allocated with
+   malloc() and owned by the handle. The base points are those from
+   which the hull was last built with qh_new_qhull(). Points added
+   later are tested against the hull, and those outside it are copied
+   into one chunk per call and passed to qh_addpoint(), which appends
+   them to qh->other_points. Points inside the hull cannot change it,
+   so they are not kept. */
+
+/* Least number of added points at which an incremental hull is
+   rebuilt by incrementalCompact() */
+#define INCREMENTAL_MIN_COMPACT 256
+
+/* State of an incremental hull */
+typedef struct {
+  qhT *qh;
+  int dim;
+  int npoints;        /* Number of points passed so far */
+  double *base;       /* Base points, row-major */
+  int *baserows;      /* 0-based row of each base point */
+  int nbase;
+  double **chunks;    /* Points passed to qh_addpoint() */
+  int nchunks, maxchunks;
+  int *otherrows;     /* 0-based row of each point in qh->other_points */
+  int nother, maxother;
+  int compactother;   /* Value of nother at which to rebuild the hull */
+  char flags[250];
+  char errstr[ERRSTRSIZE];
+} qhullIncrementalT;
+
+/* Free the points held by h, apart from the base points */
+static void incrementalFreeChunks(qhullIncrementalT *h)
+{
+  for (int i = 0; i < h->nchunks; i++)
+    free(h->chunks[i]);
+  free(h->chunks);
+  free(h->otherrows);
+  h->chunks = NULL;
+  h->otherrows = NULL;
+  h->nchunks = h->maxchunks = h->nother = h->maxother = 0;
+}
+
+static void incrementalFree(qhullIncrementalT *h)
+{
+  if (h->qh)
+    freeQhull(h->qh);
+  incrementalFreeChunks(h);
+  free(h->base);
+  free(h->baserows);
+  free(h);
+}
+
+/* Finalizer registered by C_convhulln_incremental() */
+static void incrementalFinalizer(SEXP ptr)
+{
+  if (!R_ExternalPtrAddr(ptr)) return;
+  incrementalFree(R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+/* Free h after a Qhull error, which leaves the hull unusable, and
+   report the error */
+static void incrementalError(SEXP ptr, qhullIncrementalT *h, int exitcode)
+{
+  char errstr[ERRSTRSIZE];
+  strncpy(errstr, h->errstr, ERRSTRSIZE);
+  errstr[ERRSTRSIZE - 1] = '\0';
+  incrementalFree(h);
+  R_ClearExternalPtr(ptr);
+  Rf_error("Received error code %d from qhull. Qhull error:\n%s", exitcode, errstr);
+}
+
+static qhullIncrementalT *incrementalHandle(const SEXP ptr)
+{
+  if (TYPEOF(ptr) != EXTPTRSXP || !R_ExternalPtrAddr(ptr)) {
+    Rf_error("Incremental hull is no longer available");
+  }
+  return(R_ExternalPtrAddr(ptr));
+}
+
+/* Build the hull of the n base points of h with Qhull. If successful,
+   the previous hull is freed. */
+static int incrementalBuild(qhullIncrementalT *h, double *base, int *baserows, int n)
+{
+  qhT *qh = (qhT *) malloc(sizeof(qhT));
+  if (!qh)
+    return(qh_ERRmem);
+  h->errstr[0] = '\0';
+  qh_zero(qh, qh_FILEstderr);
+  qh->cpp_user = h->errstr;
+  int exitcode = qh_new_qhull(qh, h->dim, n, base, False, h->flags, NULL, qh_FILEstderr);
+  qh->cpp_user = NULL;
+  if (exitcode) {
+    freeQhull(qh);
+    return(exitcode);
+  }
+  if (h->qh)
+    freeQhull(h->qh);
+  incrementalFreeChunks(h);
+  free(h->base);
+  free(h->baserows);
+  h->qh = qh;
+  h->base = base;
+  h->baserows = baserows;
+  h->nbase = n;
+  h->compactother = qh->num_vertices > INCREMENTAL_MIN_COMPACT ? qh->num_vertices : INCREMENTAL_MIN_COMPACT;
+  return(0);
+}
+
+typedef struct {
+  const double *point;
+  int row;
+} incrementalRowT;
+
+static int incrementalRowCompare(const void *a, const void *b)
+{
+  uintptr_t pa = (uintptr_t) ((const incrementalRowT *) a)->point;
+  uintptr_t pb = (uintptr_t) ((const incrementalRowT *) b)->point;
+  return(pa < pb ? -1 : pa > pb);
+}
+
+/* Return a table of the rows of the points in qh->other_points,
+   sorted by address, for incrementalPointRow() */
+static incrementalRowT *incrementalOtherRows(qhullIncrementalT *h)
+{
+  qhT *qh = h->qh;
+  pointT *point, **pointp;
+  int i = 0;
+  if (qh_setsize(qh, qh->other_points) != h->nother) {
+    Rf_error("Incremental hull has lost track of its points");
+  }
+  incrementalRowT *table = (incrementalRowT *) R_alloc(h->nother + 1, sizeof(incrementalRowT));
+  FOREACHpoint_(qh->other_points) {
+    table[i].point = point;
+    table[i].row = h->otherrows[i];
+    i++;
+  }
+  qsort(table, h->nother, sizeof(incrementalRowT), incrementalRowCompare);
+  return(table);
+}
+
+/* 0-based row of point, given the table from incrementalOtherRows() */
+static int incrementalPointRow(qhullIncrementalT *h, incrementalRowT *table, const double *point)
+{
+  if (point >= h->base && point < h->base + (size_t)h->nbase*h->dim)
+    return(h->baserows[(point - h->base)/h->dim]);
+  incrementalRowT key, *found;
+  key.point = point;
+  found = bsearch(&key, table, h->nother, sizeof(incrementalRowT), incrementalRowCompare);
+  return(found ? found->row : -1);
+}
+
+/* Rebuild the hull from its vertices. qh_pointid() searches
+   qh->other_points linearly, so adding points gets slower as they
+   accumulate; rebuilding whenever they outnumber the vertices of the
+   hull when it was last built keeps this search short at an
+   amortised cost. The hull of the vertices is the hull of all the
+   points so far. */
+static int incrementalCompact(qhullIncrementalT *h)
+{
+  qhT *qh = h->qh;
+  vertexT *vertex;
+  int nv = 0, i = 0, dim = h->dim;
+  FORALLvertices
+    nv++;
+  incrementalRowT *table = incrementalOtherRows(h);
+  double *base = (double *) malloc((size_t)nv*dim*sizeof(double));
+  int *baserows = (int *) malloc(nv*sizeof(int));
+  if (!base || !baserows) {
+    free(base);
+    free(baserows);
+    return(qh_ERRmem);
+  }
+  FORALLvertices {
+    memcpy(base + (size_t)dim*i, vertex->point, dim*sizeof(double));
+    baserows[i++] = incrementalPointRow(h, table, vertex->point);
+  }
+  int exitcode = incrementalBuild(h, base, baserows, nv);
+  if (exitcode) {
+    free(base);
+    free(baserows);
+  }
+  return(exitcode);
+}
+
+/* Create an incremental hull of the n-by-dim matrix of points p with
+   the Qhull options, which should not include triangulation (Qt),
+   joggling (QJ) or options that modify the points, since
+   qh_addpoint() cannot be used after these. */
+SEXP C_convhulln_incremental(const SEXP p, const SEXP options)
+{
+  if(!Rf_isString(options) || Rf_length(options) != 1){
+    Rf_error("Second argument must be a single string.");
+  }
+  if(!Rf_isMatrix(p) || !Rf_isReal(p)){
+    Rf_error("First argument should be a real matrix.");
+  }
+  if (LENGTH(STRING_ELT(options, 0)) > 200)
+    Rf_error("Option string too long");
+  int n = Rf_nrows(p), dim = Rf_ncols(p), i, j;
+  if(dim <= 0 || n <= 0){
+    Rf_error("Invalid input matrix.");
+  }
+
+  qhullIncrementalT *h = (qhullIncrementalT *) calloc(1, sizeof(qhullIncrementalT));
+  double *base = (double *) malloc((size_t)n*dim*sizeof(double));
+  int *baserows = (int *) malloc(n*sizeof(int));
+  if (!h || !base || !baserows) {
+    free(h);
+    free(base);
+    free(baserows);
+    Rf_error("Unable to allocate memory for incremental hull");
+  }
+  h->dim = dim;
+  h->npoints = n;
+  snprintf(h->flags, 249, "qhull %s", CHAR(STRING_ELT(options, 0)));
+  if (qhullModifiesInput(h->flags)) {
+    free(h);
+    free(base);
+    free(baserows);
+    Rf_error("Options that scale or rotate the points cannot be used with incremental hulls");
+  }
+  for (i = 0; i < n; i++) {
+    baserows[i] = i;
+    for (j = 0; j < dim; j++)
+      base[(size_t)dim*i + j] = REAL(p)[i + (size_t)n*j];
+  }
+  int exitcode = incrementalBuild(h, base, baserows, n);
+  if (exitcode) {
+    char errstr[ERRSTRSIZE];
+    strncpy(errstr, h->errstr, ERRSTRSIZE);
+    errstr[ERRSTRSIZE - 1] = '\0';
+    free(base);
+    free(baserows);
+    incrementalFree(h);
+    Rf_error("Received error code %d from qhull. Qhull error:\n%s", exitcode, errstr);
+  }
+
+  SEXP ptr, tag;
+  tag = PROTECT(Rf_allocVector(STRSXP, 1));
+  SET_STRING_ELT(tag, 0, Rf_mkChar("convhulln_incremental"));
+  ptr = PROTECT(R_MakeExternalPtr(h, tag, R_NilValue));
+  R_RegisterCFinalizerEx(ptr, incrementalFinalizer, TRUE);
+  UNPROTECT(2);
+
+  return ptr;
+}
+
+/* Add the points p to the incremental hull pointed to by ptr. Points
+   inside the hull are ignored; the remainder are tested and added to
+   the hull one by one with qh_addpoint(). Returns the number of the
+   points that are vertices of the hull once all have been added. */
+SEXP C_convhulln_incremental_add(const SEXP ptr, const SEXP p)
+{
+  qhullIncrementalT *h = incrementalHandle(ptr);
+  if(!Rf_isMatrix(p) || !Rf_isReal(p)){
+    Rf_error("Second argument should be a real matrix.");
+  }
+  int n = Rf_nrows(p), dim = h->dim, i, j;
+  if (Rf_ncols(p) != dim) {
+    Rf_error("Number of columns in points p (%d) not equal to dimension of hull (%d).", Rf_ncols(p), dim);
+  }
+  if (n == 0)
+    return(Rf_ScalarInteger(0));
+
+  /* The hull only grows, so only points outside the current hull can
+     be outside it after other points are added */
+  qhT *qh = h->qh;
+  double *point = (double *) R_alloc(dim, sizeof(double));
+  int *cand = (int *) R_alloc(n, sizeof(int));
+  int ncand = 0;
+  realT bestdist;
+  boolT isoutside;
+  h->errstr[0] = '\0';
+  qh->cpp_user = h->errstr;
+  int exitcode = setjmp(qh->errexit);
+  if (!exitcode) {
+    qh->NOerrexit = False;
+    for (i = 0; i < n; i++) {
+      for (j = 0; j < dim; j++)
+        point[j] = REAL(p)[i + (size_t)n*j];
+      qh_findbestfacet(qh, point, !qh_ALL, &bestdist, &isoutside);
+      if (isoutside)
+        cand[ncand++] = i;
+    }
+  }
+  qh->NOerrexit = True;
+  qh->cpp_user = NULL;
+  if (exitcode)
+    incrementalError(ptr, h, exitcode);
+
+  int nadded = 0;
+  if (ncand > 0) {
+    double *chunk = (double *) malloc((size_t)ncand*dim*sizeof(double));
+    if (h->nchunks == h->maxchunks) {
+      double **chunks = (double **) realloc(h->chunks, (2*h->maxchunks + 16)*sizeof(double *));
+      if (chunks) {
+        h->chunks = chunks;
+        h->maxchunks = 2*h->maxchunks + 16;
+      }
+    }
+    if (h->nother + ncand > h->maxother) {
+      int *otherrows = (int *) realloc(h->otherrows, (2*h->maxother + ncand)*sizeof(int));
+      if (otherrows) {
+        h->otherrows = otherrows;
+        h->maxother = 2*h->maxother + ncand;
+      }
+    }
+    if (!chunk || h->nchunks == h->maxchunks || h->nother + ncand > h->maxother) {
+      free(chunk);
+      Rf_error("Unable to allocate memory for points added to incremental hull");
+    }
+    h->chunks[h->nchunks++] = chunk;
+    for (i = 0; i < ncand; i++)
+      for (j = 0; j < dim; j++)
+        chunk[(size_t)dim*i + j] = REAL(p)[cand[i] + (size_t)n*j];
+
+    /* Only the vertex of each added point gets a new id */
+    unsigned int vertexid = qh->vertex_id;
+    qh->cpp_user = h->errstr;
+    exitcode = setjmp(qh->errexit);
+    if (!exitcode) {
+      qh->NOerrexit = False;
+      for (i = 0; i < ncand; i++) {
+        pointT *pt = chunk + (size_t)dim*i;
+        facetT *facet = qh_findbestfacet(qh, pt, !qh_ALL, &bestdist, &isoutside);
+        if (isoutside) {
+          /* qh_addpoint() appends the point to qh->other_points */
+          h->otherrows[h->nother++] = h->npoints + cand[i];
+          if (!qh_addpoint(qh, pt, facet, False))
+            break;
+        }
+      }
+    }
+    qh->NOerrexit = True;
+    qh->cpp_user = NULL;
+    if (exitcode)
+      incrementalError(ptr, h, exitcode);
+
+    /* qh_addpoint() may make a point coplanar rather than a vertex,
+       and a vertex may be merged away or be inside the hull of later
+       points, so count the new vertices that remain */
+    vertexT *vertex;
+    FORALLvertices {
+      if (vertex->id >= vertexid && !vertex->deleted)
+        nadded++;
+    }
+  }
+  h->npoints += n;
+
+  if (h->nother > h->compactother) {
+    exitcode = incrementalCompact(h);
+    if (exitcode)
+      incrementalError(ptr, h, exitcode);
+  }
+
+  return(Rf_ScalarInteger(nadded));
+}
+
+/* Return the hull pointed to by ptr in the same form as
+   C_convhulln(), with the indices of its vertices referring to all
+   the points passed so far, in order. If returnNonTriangulatedFacets
+   is FALSE, each non-simplicial facet is triangulated by joining its
+   first vertex to each of its ridges that does not contain that
+   vertex, as qh_triangulate() does, without modifying the hull so
+   that more points can be added. */
+SEXP C_convhulln_incremental_hull(const SEXP ptr, const SEXP returnNonTriangulatedFacets,
+                                  const SEXP areaVol, const SEXP normals)
+{
+  qhullIncrementalT *h = incrementalHandle(ptr);
+  qhT *qh = h->qh;
+  facetT *facet;
+  vertexT *vertex, **vertexp, *apex;
+  ridgeT *ridge, **ridgep;
+  int dim = h->dim, nonTri = Rf_asLogical(returnNonTriangulatedFacets) == TRUE;
+  int nrow = 0, ncol = dim, i, j, k;
+
+  /* Count the rows of the output */
+  FORALLfacets {
+    if (nonTri) {
+      j = qh_setsize(qh, facet->vertices);
+      if (j > ncol)
+        ncol = j;
+      nrow++;
+    } else if (facet->simplicial) {
+      nrow++;
+    } else {
+      apex = SETfirstt_(facet->vertices, vertexT);
+      FOREACHridge_(facet->ridges)
+        if (!qh_setin(ridge->vertices, apex))
+          nrow++;
+    }
+  }
+
+  incrementalRowT *table = incrementalOtherRows(h);
+  SEXP hull, area, vol, norm, retlist, retnames;
+  hull = PROTECT(Rf_allocMatrix(INTSXP, nrow, ncol));
+  int getNormals = Rf_asLogical(normals) == TRUE;
+  norm = PROTECT(getNormals ? Rf_allocMatrix(REALSXP, nrow, dim + 1) : R_NilValue);
+  int *hl = INTEGER(hull);
+  i = 0;
+  FORALLfacets {
+    int first = i;
+    if (nonTri || facet->simplicial) {
+      j = 0;
+      FOREACHvertex_(facet->vertices)
+        hl[i + (size_t)nrow*j++] = 1 + incrementalPointRow(h, table, vertex->point);
+      while (j < ncol)
+        hl[i + (size_t)nrow*j++] = NA_INTEGER;
+      i++;
+    } else {
+      apex = SETfirstt_(facet->vertices, vertexT);
+      FOREACHridge_(facet->ridges) {
+        if (qh_setin(ridge->vertices, apex))
+          continue;
+        hl[i] = 1 + incrementalPointRow(h, table, apex->point);
+        j = 1;
+        FOREACHvertex_(ridge->vertices)
+          hl[i + (size_t)nrow*j++] = 1 + incrementalPointRow(h, table, vertex->point);
+        i++;
+      }
+    }
+    if (getNormals) {
+      for (; first < i; first++)
+        for (k = 0; k <= dim; k++)
+          REAL(norm)[first + (size_t)nrow*k] = facet->normal ? (k < dim ? facet->normal[k] : facet->offset) : 0;
+    }
+  }
+
+  area = PROTECT(R_NilValue);
+  vol = PROTECT(R_NilValue);
+  if (Rf_asLogical(areaVol) == TRUE) {
+    /* The areas of facets that have been merged since they were last
+       computed are out of date */
+    FORALLfacets
+      facet->isarea = False;
+    qh->hasAreaVolume = False;
+    h->errstr[0] = '\0';
+    qh->cpp_user = h->errstr;
+    int exitcode = setjmp(qh->errexit);
+    if (!exitcode) {
+      qh->NOerrexit = False;
+      qh_getarea(qh, qh->facet_list);
+    }
+    qh->NOerrexit = True;
+    qh->cpp_user = NULL;
+    if (exitcode) {
+      UNPROTECT(4);
+      incrementalError(ptr, h, exitcode);
+    }
+    UNPROTECT(2);
+    area = PROTECT(Rf_ScalarReal(qh->totarea));
+    vol = PROTECT(Rf_ScalarReal(qh->totvol));
+  }
+
+  retlist = PROTECT(Rf_allocVector(VECSXP, 4));
+  retnames = PROTECT(Rf_allocVector(STRSXP, 4));
+  SET_VECTOR_ELT(retlist, 0, hull);
+  SET_STRING_ELT(retnames, 0, Rf_mkChar("hull"));
+  SET_VECTOR_ELT(retlist, 1, area);
+  SET_STRING_ELT(retnames, 1, Rf_mkChar("area"));
+  SET_VECTOR_ELT(retlist, 2, vol);
+  SET_STRING_ELT(retnames, 2, Rf_mkChar("vol"));
+  SET_VECTOR_ELT(retlist, 3, norm);
+  SET_STRING_ELT(retnames, 3, Rf_mkChar("normals"));
+  Rf_setAttrib(retlist, R_NamesSymbol, retnames);
+  UNPROTECT(6);
+
+  return retlist;
+}
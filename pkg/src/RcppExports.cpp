@@ -11,8 +11,8 @@ Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
 // C_tsearch
-SEXP C_tsearch(NumericVector x, NumericVector y, IntegerMatrix elem, NumericVector xi, NumericVector yi, bool bary, double eps);
-RcppExport SEXP _geometry_C_tsearch(SEXP xSEXP, SEXP ySEXP, SEXP elemSEXP, SEXP xiSEXP, SEXP yiSEXP, SEXP barySEXP, SEXP epsSEXP) {
+SEXP C_tsearch(NumericVector x, NumericVector y, IntegerMatrix elem, NumericVector xi, NumericVector yi, bool bary, double eps, int nthreads, int leaf_size, int max_depth);
+RcppExport SEXP _geometry_C_tsearch(SEXP xSEXP, SEXP ySEXP, SEXP elemSEXP, SEXP xiSEXP, SEXP yiSEXP, SEXP barySEXP, SEXP epsSEXP, SEXP nthreadsSEXP, SEXP leaf_sizeSEXP, SEXP max_depthSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -23,7 +23,70 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< NumericVector >::type yi(yiSEXP);
     Rcpp::traits::input_parameter< bool >::type bary(barySEXP);
     Rcpp::traits::input_parameter< double >::type eps(epsSEXP);
-    rcpp_result_gen = Rcpp::wrap(C_tsearch(x, y, elem, xi, yi, bary, eps));
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< int >::type leaf_size(leaf_sizeSEXP);
+    Rcpp::traits::input_parameter< int >::type max_depth(max_depthSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_tsearch(x, y, elem, xi, yi, bary, eps, nthreads, leaf_size, max_depth));
+    return rcpp_result_gen;
+END_RCPP
+}
+// C_tsearch_locator
+SEXP C_tsearch_locator(NumericVector x, NumericVector y, IntegerMatrix elem, double eps);
+RcppExport SEXP _geometry_C_tsearch_locator(SEXP xSEXP, SEXP ySEXP, SEXP elemSEXP, SEXP epsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type y(ySEXP);
+    Rcpp::traits::input_parameter< IntegerMatrix >::type elem(elemSEXP);
+    Rcpp::traits::input_parameter< double >::type eps(epsSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_tsearch_locator(x, y, elem, eps));
+    return rcpp_result_gen;
+END_RCPP
+}
+// C_tsearch_locate
+SEXP C_tsearch_locate(List locator, NumericVector xi, NumericVector yi, bool bary, bool walk, int nthreads);
+RcppExport SEXP _geometry_C_tsearch_locate(SEXP locatorSEXP, SEXP xiSEXP, SEXP yiSEXP, SEXP barySEXP, SEXP walkSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type locator(locatorSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type xi(xiSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type yi(yiSEXP);
+    Rcpp::traits::input_parameter< bool >::type bary(barySEXP);
+    Rcpp::traits::input_parameter< bool >::type walk(walkSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_tsearch_locate(locator, xi, yi, bary, walk, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// C_tsearch_locate_file
+int C_tsearch_locate_file(List locator, NumericVector xi, NumericVector yi, std::string idx_file, std::string bary_file, bool walk, int nthreads);
+RcppExport SEXP _geometry_C_tsearch_locate_file(SEXP locatorSEXP, SEXP xiSEXP, SEXP yiSEXP, SEXP idx_fileSEXP, SEXP bary_fileSEXP, SEXP walkSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type locator(locatorSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type xi(xiSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type yi(yiSEXP);
+    Rcpp::traits::input_parameter< std::string >::type idx_file(idx_fileSEXP);
+    Rcpp::traits::input_parameter< std::string >::type bary_file(bary_fileSEXP);
+    Rcpp::traits::input_parameter< bool >::type walk(walkSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_tsearch_locate_file(locator, xi, yi, idx_file, bary_file, walk, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// C_tsearchn_simplex
+List C_tsearchn_simplex(NumericMatrix x, IntegerMatrix t, NumericMatrix xi);
+RcppExport SEXP _geometry_C_tsearchn_simplex(SEXP xSEXP, SEXP tSEXP, SEXP xiSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericMatrix >::type x(xSEXP);
+    Rcpp::traits::input_parameter< IntegerMatrix >::type t(tSEXP);
+    Rcpp::traits::input_parameter< NumericMatrix >::type xi(xiSEXP);
+    rcpp_result_gen = Rcpp::wrap(C_tsearchn_simplex(x, t, xi));
     return rcpp_result_gen;
 END_RCPP
 }
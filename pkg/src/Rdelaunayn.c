@@ -30,12 +30,21 @@
 
 20. May 2005 - Raoul Grasman: ported to R
  * Changed the interface for R
+
+18. October 2026: added C_delaunayn_batch() for the triangulations of
+many groups of points
+
+18. October 2026: added C_delaunayn_kd() for triangulating
+partitions of large sets of points in parallel
+
+18. October 2026: added keepQhull argument to free the triangulation
+when it is not needed for tsearchn()
 */
 
 #include "Rgeometry.h"
-#include <unistd.h>              /* For unlink() */
 
-SEXP C_delaunayn(const SEXP p, const SEXP options, SEXP tmp_stdout, SEXP tmp_stderr)
+SEXP C_delaunayn(const SEXP p, const SEXP options, const SEXP transposed, const SEXP spatialSort,
+                 const SEXP neighbourMatrix, const SEXP keepQhull)
 {
   /* Initialise return values */ 
 
@@ -54,10 +63,14 @@ SEXP C_delaunayn(const SEXP p, const SEXP options, SEXP tmp_stdout, SEXP tmp_std
   /* Qz forces triangulation when the number of points is equal to the
      number of dimensions + 1 ; This mirrors the behaviour of octave
      and matlab */
-  if (Rf_nrows(p) == Rf_ncols(p) + 1) {
+  boolT istransposed = Rf_asLogical(transposed) == TRUE;
+  if ((istransposed ? Rf_ncols(p) : Rf_nrows(p)) ==
+      (istransposed ? Rf_nrows(p) : Rf_ncols(p)) + 1) {
     strncat(cmd, " Qz", 4);
   }
-  int exitcode = qhullNewQhull(qh, p, cmd,  options, tmp_stdout, tmp_stderr, &dim, &n, errstr);
+  int *order = NULL;
+  int exitcode = qhullNewQhull(qh, p, cmd,  options, istransposed,
+                               Rf_asLogical(spatialSort) == TRUE ? &order : NULL, &dim, &n, errstr);
 
   /* Extract information from output */
   
@@ -71,19 +84,29 @@ SEXP C_delaunayn(const SEXP p, const SEXP options, SEXP tmp_stdout, SEXP tmp_std
     vertexT *vertex, **vertexp;
     facetT *neighbor, **neighborp;
 
-    /* Count the number of facets so we know how much space to
-       allocate in R */
-    int nf=0;                 /* Number of facets */
+    /* Resolve the print options once */
+    boolT hasneighbours = hasPrintOption(qh, qh_PRINTneighbors);
+    boolT hasareas = hasPrintOption(qh, qh_PRINTarea);
+    boolT ismatrix = hasneighbours && Rf_asLogical(neighbourMatrix) == TRUE;
+
+    /* Collect the simplices in one pass through the facets. There
+       are fewer simplices than facets, so the buffers do not need to
+       grow. Degenerate (zero area) simplices are removed. They can
+       only arise from the triangulation of non-simplicial facets by
+       the option Qt, or if Qhull does not merge facets, so otherwise
+       the area is only computed if it is requested. If the
+       neighbours are returned as a matrix, map the ID of each facet
+       to its 1-based row in tri, or 0 if it is not in tri. */
+    int maxnf = qh->num_facets;
+    int *vbuf = (int *) R_alloc((size_t) maxnf*(dim + 1) + 1, sizeof(int));
+    facetT **fbuf = (facetT **) R_alloc((size_t) maxnf + 1, sizeof(facetT *));
+    int *rowmap = NULL;
+    if (ismatrix) {
+      rowmap = (int *) R_alloc(qh->facet_id + 1, sizeof(int));
+      memset(rowmap, 0, (qh->facet_id + 1)*sizeof(int));
+    }
+    int nf=0;                 /* Number of simplices */
     FORALLfacets {
-      if (!facet->upperdelaunay) {
-        /* Remove degenerate simplicies */
-        if (!facet->isarea) {
-          facet->f.area= qh_facetarea(qh, facet);
-          facet->isarea= True;
-        }
-        if (facet->f.area)
-          nf++;
-      }
       /* Double check. Non-simplicial facets will cause segfault
          below */
       if (! facet->simplicial) {
@@ -91,70 +114,95 @@ SEXP C_delaunayn(const SEXP p, const SEXP options, SEXP tmp_stdout, SEXP tmp_std
         exitcode = 1;
         break;
       }
+      if (facet->upperdelaunay)
+        continue;
+      if (hasareas || facet->tricoplanar || !qh->MERGING) {
+        if (!facet->isarea) {
+          facet->f.area= qh_facetarea(qh, facet);
+          facet->isarea= True;
+        }
+        if (!facet->f.area)
+          continue;
+      }
+      if (nf >= maxnf) {
+        Rf_error("Trying to access non-existent facet %i", nf);
+      }
+      int j=0;
+      FOREACHvertex_ (facet->vertices) {
+        if (j > (int) dim)
+          Rf_error("Trying to write to non-existent area of memory i=%i, j=%i, nf=%i, dim=%i", nf, j, maxnf, dim);
+        vbuf[(dim + 1)*nf + j++] = 1 + qhullPointRow(order, qh_pointid(qh, vertex->point));
+      }
+      fbuf[nf++] = facet;
+      if (ismatrix)
+        rowmap[facet->id] = nf;
+    }
+
+    /* The neighbours are identified by the numbers that Qhull gives
+       the facets when printing them, which it no longer does, so
+       number the facets here */
+    if (hasneighbours && !ismatrix) {
+      int numfacets, numsimplicial, totneighbors, numridges, numcoplanars, numtricoplanars;
+      qh_countfacets(qh, qh->facet_list, NULL, !qh_ALL, &numfacets, &numsimplicial,
+                     &totneighbors, &numridges, &numcoplanars, &numtricoplanars);
     }
-      
+
     /* Alocate the space in R */
     PROTECT(tri = Rf_allocMatrix(INTSXP, nf, dim+1));
-    if (hasPrintOption(qh, qh_PRINTneighbors)) {
+    if (ismatrix) {
+      PROTECT(neighbours = Rf_allocMatrix(INTSXP, nf, dim+1));
+    } else if (hasneighbours) {
       PROTECT(neighbours = Rf_allocVector(VECSXP, nf));
     } else {
       PROTECT(neighbours = R_NilValue);
     }
-    if (hasPrintOption(qh, qh_PRINTarea)) {
+    if (hasareas) {
       PROTECT(areas = Rf_allocVector(REALSXP, nf));
     } else {
       PROTECT(areas = R_NilValue);
     }
-    
-    /* Iterate through facets to extract information */
-    int i=0;
-    FORALLfacets {
-      if (!facet->upperdelaunay && facet->f.area) {
-        if (i >= nf) {
-          Rf_error("Trying to access non-existent facet %i", i);
-        }
 
-        /* Triangulation */
-        int j=0;
-        FOREACHvertex_ (facet->vertices) {
-          if ((i + nf*j) >= nf*(dim+1))
-            Rf_error("Trying to write to non-existent area of memory i=%i, j=%i, nf=%i, dim=%i", i, j, nf, dim);
-          INTEGER(tri)[i + nf*j] = 1 + qh_pointid(qh, vertex->point);
-          j++;
-        }
+    /* Copy the simplices to R */
+    int i, j;
+    int *ptri = INTEGER(tri);
+    for (j = 0; j <= (int) dim; j++)
+      for (i = 0; i < nf; i++)
+        ptri[i + (size_t)nf*j] = vbuf[(dim + 1)*i + j];
 
-        /* Neighbours - option Fn */
-        if (hasPrintOption(qh, qh_PRINTneighbors)) {
-          PROTECT(neighbour = Rf_allocVector(INTSXP, qh_setsize(qh, facet->neighbors)));
-          j=0;
-          FOREACHneighbor_(facet) {
-            INTEGER(neighbour)[j] = neighbor->visitid ? neighbor->visitid: 0 - neighbor->id;
-            j++;
-          }
-          SET_VECTOR_ELT(neighbours, i, neighbour);
-          UNPROTECT(1);
-        }
+    for (i = 0; i < nf; i++) {
+      facet = fbuf[i];
 
-        /* Areas - option Fa */
-        if (hasPrintOption(qh, qh_PRINTarea)) {
-          /* Area. Code modified from qh_getarea() in libquhull/geom2.c */
-          if ((facet->normal) && !(facet->upperdelaunay && qh->ATinfinity)) {
-            if (!facet->isarea) {
-              facet->f.area= qh_facetarea(qh, facet);
-              facet->isarea= True;
-            }
-            REAL(areas)[i] = facet->f.area;
-          }
+      /* Neighbours - option Fn. As the facets are simplicial, the
+         jth neighbour is opposite the jth vertex. */
+      if (ismatrix) {
+        j=0;
+        FOREACHneighbor_(facet) {
+          INTEGER(neighbours)[i + (size_t)nf*j] = rowmap[neighbor->id] ? rowmap[neighbor->id] : NA_INTEGER;
+          j++;
+        }
+      } else if (hasneighbours) {
+        PROTECT(neighbour = Rf_allocVector(INTSXP, qh_setsize(qh, facet->neighbors)));
+        j=0;
+        FOREACHneighbor_(facet) {
+          INTEGER(neighbour)[j] = neighbor->visitid ? neighbor->visitid: 0 - neighbor->id;
+          j++;
         }
+        SET_VECTOR_ELT(neighbours, i, neighbour);
+        UNPROTECT(1);
+      }
 
-        i++;
+      /* Areas - option Fa, computed above */
+      if (hasareas && facet->normal) {
+        REAL(areas)[i] = facet->f.area;
       }
     }
   } else { /* exitcode != 1 */
     /* There has been an error; Qhull will print the error
        message */
     PROTECT(tri = Rf_allocMatrix(INTSXP, 0, dim+1));
-    if (hasPrintOption(qh, qh_PRINTneighbors)) {
+    if (hasPrintOption(qh, qh_PRINTneighbors) && Rf_asLogical(neighbourMatrix) == TRUE) {
+      PROTECT(neighbours = Rf_allocMatrix(INTSXP, 0, dim+1));
+    } else if (hasPrintOption(qh, qh_PRINTneighbors)) {
       PROTECT(neighbours = Rf_allocVector(VECSXP, 0));
     } else {
       PROTECT(neighbours = R_NilValue);
@@ -199,7 +247,7 @@ SEXP C_delaunayn(const SEXP p, const SEXP options, SEXP tmp_stdout, SEXP tmp_std
   PROTECT(tag = Rf_allocVector(STRSXP, 1));
   SET_STRING_ELT(tag, 0, Rf_mkChar("delaunayn"));
   PROTECT(ptr = R_MakeExternalPtr(qh, tag, R_NilValue));
-  if (exitcode) {
+  if (exitcode || Rf_asLogical(keepQhull) != TRUE) {
     qhullFinalizer(ptr);
   } else {
     R_RegisterCFinalizerEx(ptr, qhullFinalizer, TRUE);
@@ -216,3 +264,777 @@ SEXP C_delaunayn(const SEXP p, const SEXP options, SEXP tmp_stdout, SEXP tmp_std
 }
 
 
+
+/* Extract the simplices of the triangulation of one group of points
+   in C_delaunayn_batch() */
+static void delaunaynBatchExtract(qhT *qh, int exitcode, int g, const int *rows, int n, int dim, void *data, qhullBatchT *res)
+{
+  if (exitcode) {
+    /* As in C_delaunayn(), dim + 1 points that do not form a simplex
+       have an empty triangulation rather than an error */
+    if ((dim + 1) == n)
+      res->exitcode = 0;
+    return;
+  }
+  facetT *facet;
+  vertexT *vertex, **vertexp;
+  res->facets = (int *) malloc(((size_t) qh->num_facets*(dim + 1) + 1)*sizeof(int));
+  if (!res->facets) {
+    res->exitcode = qh_ERRmem;
+    return;
+  }
+  int i = 0, j;
+  FORALLfacets {
+    if (!facet->simplicial) {
+      res->exitcode = 1;
+      return;
+    }
+    if (!facet->upperdelaunay) {
+      /* Remove degenerate simplicies */
+      if (!facet->isarea) {
+        facet->f.area= qh_facetarea(qh, facet);
+        facet->isarea= True;
+      }
+      if (facet->f.area) {
+        j = 0;
+        FOREACHvertex_ (facet->vertices) {
+          if (j <= dim)
+            res->facets[(dim + 1)*i + j++] = 1 + rows[qh_pointid(qh, vertex->point)];
+        }
+        i++;
+      }
+    }
+  }
+  res->nf = i;
+}
+
+/* Compute the Delaunay triangulations of groups of the points in the
+   rows of p. The rows of group g are rows[offsets[g]], ...,
+   rows[offsets[g + 1] - 1] (0-based). Returns the simplices of all
+   the triangulations as one matrix of 1-based row indices into p, the
+   offsets of each group's simplices in this matrix, and the Qhull
+   exit code of each triangulation. */
+SEXP C_delaunayn_batch(const SEXP p, const SEXP rows, const SEXP offsets, const SEXP options, const SEXP nthreads)
+{
+  if(!Rf_isMatrix(p) || !Rf_isReal(p)){
+    Rf_error("First argument should be a real matrix.");
+  }
+  if(!Rf_isString(options) || Rf_length(options) != 1){
+    Rf_error("Options must be a single string.");
+  }
+  if (LENGTH(STRING_ELT(options, 0)) > 200)
+    Rf_error("Option string too long");
+
+  const int dim = Rf_ncols(p);
+  const int ng = Rf_length(offsets) - 1;
+  char flags[250], flags_simplex[250];
+  snprintf(flags, 249, "qhull d Qbb T0 %s", CHAR(STRING_ELT(options, 0)));
+  /* Qz forces triangulation when the number of points is equal to the
+     number of dimensions + 1, as in C_delaunayn() */
+  snprintf(flags_simplex, 249, "qhull d Qbb T0 Qz %s", CHAR(STRING_ELT(options, 0)));
+
+  qhullBatchT *res = (qhullBatchT *) R_alloc(ng, sizeof(qhullBatchT));
+  char errstr[ERRSTRSIZE];
+  if (qhullBatch(REAL(p), Rf_nrows(p), dim, INTEGER(rows), INTEGER(offsets), ng,
+                 flags, flags_simplex, INTEGER(nthreads)[0], delaunaynBatchExtract, NULL, res, errstr))
+    Rf_error("Interrupted");
+
+  return qhullBatchResult(res, ng, dim + 1, "tri", errstr);
+}
+
+/* Parallel Delaunay triangulation by spatial partitioning
+
+   The points are divided into partitions by recursively splitting
+   them at the median of their widest coordinate, so that each
+   partition lies in a box, its cell. The partitions are triangulated
+   in parallel. A simplex of the triangulation of a partition whose
+   circumsphere lies inside the partition's cell contains no points of
+   other partitions, so is part of the Delaunay triangulation of all
+   the points. The remaining simplices lie along the seams between the
+   cells. Their points are triangulated together, and the simplices of
+   this seam triangulation that are not inside one cell and whose
+   circumspheres contain no points are added. Finally, the faces along
+   the seams are checked: each must be shared by two simplices on
+   opposite sides of it that are locally Delaunay, or lie on the
+   convex hull. If any check fails, for example because the points are
+   in a degenerate position, NULL is returned so that the caller can
+   triangulate the points in one piece. */
+
+/* Minimum number of points per partition */
+#define DELAUNAYN_KD_MIN_POINTS 1000
+
+/* Relative tolerance for a point being on a circumsphere or a
+   hyperplane */
+#define DELAUNAYN_KD_EPS 1e-10
+
+/* Result for one partition */
+typedef struct {
+  int nacc;                     /* Number of accepted simplices */
+  int *acc;                     /* dim + 1 0-based rows of each */
+  int nopen;                    /* Number of faces on the edge of the accepted simplices */
+  int *open;                    /* dim 0-based rows of each, then the opposite row */
+  int nhull;                    /* Number of points on the hull of the partition */
+  int *hull;                    /* Their 0-based rows */
+} delaunaynKdPartT;
+
+typedef struct {
+  const double *p;              /* Points, column-major */
+  int np;                       /* Number of points */
+  int dim;                      /* Dimension, 2 or 3 */
+  int npart;                    /* Number of partitions */
+  double *lo, *hi;              /* Bounds of the cell of each partition */
+  char *seam;                   /* Flags for the points on the seams */
+  delaunaynKdPartT *part;       /* Results for each partition */
+} delaunaynKdT;
+
+/* Balanced kd-tree of the points for finding the points in a
+   sphere. Node i, in heap order, divides its n points between the
+   children 2i + 1 and 2i + 2, which hold the first n/2 and the
+   remaining points. */
+typedef struct {
+  int nleaf;                    /* Number of leaves, a power of 2 */
+  int *rows;                    /* Rows of the points, by leaf */
+  double *lo, *hi;              /* Bounding box of the points of each node */
+} delaunaynKdTreeT;
+
+/* Number of points per leaf of the kd-tree */
+#define DELAUNAYN_KD_LEAF_POINTS 8
+
+/* Find the centre c and squared radius r2 of the circumsphere of the
+   simplex with 0-based rows v of the dim <= 3 dimensional points
+   p. Returns False if the simplex is degenerate. */
+static boolT circumsphere(const double *p, int np, int dim, const int *v, double *c, double *r2)
+{
+  double A[3][4];
+  int i, j, k, piv;
+  for (i = 0; i < dim; i++) {
+    A[i][dim] = 0;
+    for (j = 0; j < dim; j++) {
+      A[i][j] = p[v[i + 1] + (size_t)np*j] - p[v[0] + (size_t)np*j];
+      A[i][dim] += A[i][j]*A[i][j]/2;
+    }
+  }
+  for (k = 0; k < dim; k++) {
+    piv = k;
+    for (i = k + 1; i < dim; i++)
+      if (fabs(A[i][k]) > fabs(A[piv][k]))
+        piv = i;
+    if (A[piv][k] == 0)
+      return(False);
+    if (piv != k)
+      for (j = k; j <= dim; j++) {
+        double t = A[k][j]; A[k][j] = A[piv][j]; A[piv][j] = t;
+      }
+    for (i = k + 1; i < dim; i++) {
+      double f = A[i][k]/A[k][k];
+      for (j = k; j <= dim; j++)
+        A[i][j] -= f*A[k][j];
+    }
+  }
+  *r2 = 0;
+  for (k = dim - 1; k >= 0; k--) {
+    c[k] = A[k][dim];
+    for (j = k + 1; j < dim; j++)
+      c[k] -= A[k][j]*c[j];
+    c[k] /= A[k][k];
+    *r2 += c[k]*c[k];
+  }
+  if (!R_FINITE(*r2))
+    return(False);
+  for (j = 0; j < dim; j++)
+    c[j] += p[v[0] + (size_t)np*j];
+  return(True);
+}
+
+/* Return True if the sphere with centre c and squared radius r2 is
+   strictly inside the box with corners lo and hi */
+static boolT sphereInBox(int dim, const double *c, double r2, const double *lo, const double *hi)
+{
+  double r = sqrt(r2);
+  for (int j = 0; j < dim; j++)
+    if (c[j] - r <= lo[j] || c[j] + r >= hi[j])
+      return(False);
+  return(True);
+}
+
+/* Return True if the point q is strictly inside the sphere with
+   centre c and squared radius r2 */
+static boolT inSphere(const double *p, int np, int dim, int q, const double *c, double r2)
+{
+  double d2 = 0;
+  for (int j = 0; j < dim; j++) {
+    double d = p[q + (size_t)np*j] - c[j];
+    d2 += d*d;
+  }
+  return(d2 < r2*(1 - DELAUNAYN_KD_EPS));
+}
+
+/* Orientation of the point q with respect to the face with the dim
+   0-based rows v: the sign of the determinant of the vectors from the
+   first vertex to the other vertices and q, or 0 if the determinant
+   is no more than eps relative to the size of the vectors. */
+static int orientation(const double *p, int np, int dim, const int *v, int q, double eps)
+{
+  double a[3][3], det, scale = 0;
+  int i, j;
+  for (i = 0; i < dim; i++)
+    for (j = 0; j < dim; j++) {
+      a[i][j] = p[(i < dim - 1 ? v[i + 1] : q) + (size_t)np*j] - p[v[0] + (size_t)np*j];
+      scale = fmax(scale, fabs(a[i][j]));
+    }
+  if (dim == 2)
+    det = a[0][0]*a[1][1] - a[0][1]*a[1][0];
+  else
+    det = a[0][0]*(a[1][1]*a[2][2] - a[1][2]*a[2][1])
+      - a[0][1]*(a[1][0]*a[2][2] - a[1][2]*a[2][0])
+      + a[0][2]*(a[1][0]*a[2][1] - a[1][1]*a[2][0]);
+  if (fabs(det) <= eps*pow(scale, dim))
+    return(0);
+  return(det > 0 ? 1 : -1);
+}
+
+/* Reorder the 0-based rows[0], ..., rows[n - 1] of p so that the
+   first n/2 have no greater and the rest no smaller values of their
+   widest coordinate than rows[n/2]. Returns the coordinate in *axis and
+   the value of rows[n/2] in it. */
+static double kdSplit(const double *p, int np, int dim, int *rows, int n, int *axis)
+{
+  int i, j;
+  int jmax = 0;
+  double wmax = -1;
+  for (j = 0; j < dim; j++) {
+    double mn = HUGE_VAL, mx = -HUGE_VAL;
+    for (i = 0; i < n; i++) {
+      double x = p[rows[i] + (size_t)np*j];
+      mn = fmin(mn, x);
+      mx = fmax(mx, x);
+    }
+    if (mx - mn > wmax) {
+      wmax = mx - mn;
+      jmax = j;
+    }
+  }
+  const double *x = p + (size_t)np*jmax;
+  int m = n/2, left = 0, right = n - 1;
+  while (left < right) {
+    double pivot = x[rows[(left + right)/2]];
+    int a = left, b = right;
+    while (a <= b) {
+      while (x[rows[a]] < pivot) a++;
+      while (x[rows[b]] > pivot) b--;
+      if (a <= b) {
+        int t = rows[a]; rows[a] = rows[b]; rows[b] = t;
+        a++; b--;
+      }
+    }
+    if (m <= b)
+      right = b;
+    else if (m >= a)
+      left = a;
+    else
+      break;
+  }
+  *axis = jmax;
+  return(x[rows[m]]);
+}
+
+/* Partition the 0-based rows[0], ..., rows[n - 1] of p into npart
+   partitions, reordering rows so that the rows of partition k start
+   at offsets[k], and set the bounds of the cell of each
+   partition. npart must be a power of 2. */
+static void kdPartition(const double *p, int np, int dim, int *rows, int n, int npart,
+                        int *offsets, double *lo, double *hi)
+{
+  int i, jmax;
+  if (npart == 1) {
+    offsets[0] = 0;
+    offsets[1] = n;
+    return;
+  }
+  int m = n/2;
+  double split = kdSplit(p, np, dim, rows, n, &jmax);
+  for (i = 0; i < npart/2; i++)
+    hi[i*dim + jmax] = fmin(hi[i*dim + jmax], split);
+  for (i = npart/2; i < npart; i++)
+    lo[i*dim + jmax] = fmax(lo[i*dim + jmax], split);
+  kdPartition(p, np, dim, rows, m, npart/2, offsets, lo, hi);
+  kdPartition(p, np, dim, rows + m, n - m, npart/2, offsets + npart/2, lo + npart/2*dim, hi + npart/2*dim);
+  for (i = npart/2; i <= npart; i++)
+    offsets[i] += m;
+}
+
+/* Extract the simplices of the triangulation of partition g,
+   accepting those whose circumspheres are inside the partition's
+   cell, and recording the faces on the edge of the accepted
+   simplices, the points of the other simplices and the points on the
+   hull */
+static void delaunaynKdExtract(qhT *qh, int exitcode, int g, const int *rows, int n, int dim, void *data, qhullBatchT *res)
+{
+  if (exitcode)
+    return;
+  delaunaynKdT *kd = (delaunaynKdT *) data;
+  delaunaynKdPartT *part = &kd->part[g];
+  facetT *facet, *neighbor, **neighborp;
+  vertexT *vertex, **vertexp;
+  int v[4], i, j, k;
+  double c[3], r2;
+
+  /* Classify the simplices, using visitid to flag accepted (1) and
+     rejected (2) simplices. The points of degenerate simplices, which
+     are not in the triangulation, are also put on the seams. */
+  int nacc = 0, nopen = 0;
+  FORALLfacets {
+    facet->visitid = 0;
+    if (!facet->simplicial) {
+      res->exitcode = 1;
+      return;
+    }
+    if (facet->upperdelaunay)
+      continue;
+    if (!facet->isarea) {
+      facet->f.area= qh_facetarea(qh, facet);
+      facet->isarea= True;
+    }
+    j = 0;
+    FOREACHvertex_ (facet->vertices)
+      v[j++] = rows[qh_pointid(qh, vertex->point)];
+    if (facet->f.area && circumsphere(kd->p, kd->np, dim, v, c, &r2) &&
+        sphereInBox(dim, c, r2, kd->lo + g*dim, kd->hi + g*dim)) {
+      facet->visitid = 1;
+      nacc++;
+    } else {
+      facet->visitid = 2;
+      for (j = 0; j <= dim; j++)
+        kd->seam[v[j]] = 1;
+    }
+  }
+  FORALLfacets {
+    if (facet->visitid == 1)
+      FOREACHneighbor_(facet)
+        if (neighbor->visitid != 1)
+          nopen++;
+  }
+
+  part->acc = (int *) malloc(((size_t) nacc*(dim + 1) + 1)*sizeof(int));
+  part->open = (int *) malloc(((size_t) nopen*(dim + 1) + 1)*sizeof(int));
+  part->hull = (int *) malloc(((size_t) n + 1)*sizeof(int));
+  if (!part->acc || !part->open || !part->hull) {
+    res->exitcode = qh_ERRmem;
+    return;
+  }
+
+  /* Accepted simplices and the faces they share with other simplices
+     or, on the hull of the partition, with upper Delaunay facets. The
+     points of these faces are also put on the seams. */
+  i = k = 0;
+  FORALLfacets {
+    if (facet->visitid != 1)
+      continue;
+    j = 0;
+    FOREACHvertex_ (facet->vertices)
+      part->acc[(dim + 1)*i + j++] = rows[qh_pointid(qh, vertex->point)];
+    FOREACHneighbor_(facet) {
+      if (neighbor->visitid == 1)
+        continue;
+      int *face = part->open + (dim + 1)*k++;
+      j = 0;
+      FOREACHvertex_ (facet->vertices) {
+        if (qh_setin(neighbor->vertices, vertex)) {
+          face[j] = rows[qh_pointid(qh, vertex->point)];
+          kd->seam[face[j++]] = 1;
+        } else
+          face[dim] = rows[qh_pointid(qh, vertex->point)];
+      }
+      if (j != dim) {
+        res->exitcode = 1;
+        return;
+      }
+    }
+    i++;
+  }
+  part->nacc = nacc;
+  part->nopen = k;
+
+  /* The extreme points in any direction are vertices of the upper
+     Delaunay facets */
+  qh->vertex_visit++;
+  k = 0;
+  FORALLfacets {
+    if (!facet->upperdelaunay)
+      continue;
+    FOREACHvertex_ (facet->vertices) {
+      int id = qh_pointid(qh, vertex->point);
+      if (vertex->visitid != qh->vertex_visit && id >= 0 && id < n) {
+        vertex->visitid = qh->vertex_visit;
+        part->hull[k++] = rows[id];
+      }
+    }
+  }
+  part->nhull = k;
+}
+
+/* Build the subtree of the kd-tree at node from the n rows */
+static void kdTreeNode(const double *p, int np, int dim, int *rows, int n, int nleaf,
+                       int node, delaunaynKdTreeT *tree)
+{
+  int i, j;
+  double *lo = tree->lo + (size_t)node*dim, *hi = tree->hi + (size_t)node*dim;
+  if (nleaf == 1) {
+    for (j = 0; j < dim; j++) {
+      lo[j] = HUGE_VAL;
+      hi[j] = -HUGE_VAL;
+      for (i = 0; i < n; i++) {
+        lo[j] = fmin(lo[j], p[rows[i] + (size_t)np*j]);
+        hi[j] = fmax(hi[j], p[rows[i] + (size_t)np*j]);
+      }
+    }
+    return;
+  }
+  int axis;
+  kdSplit(p, np, dim, rows, n, &axis);
+  kdTreeNode(p, np, dim, rows, n/2, nleaf/2, 2*node + 1, tree);
+  kdTreeNode(p, np, dim, rows + n/2, n - n/2, nleaf/2, 2*node + 2, tree);
+  for (j = 0; j < dim; j++) {
+    lo[j] = fmin(tree->lo[(size_t)(2*node + 1)*dim + j], tree->lo[(size_t)(2*node + 2)*dim + j]);
+    hi[j] = fmax(tree->hi[(size_t)(2*node + 1)*dim + j], tree->hi[(size_t)(2*node + 2)*dim + j]);
+  }
+}
+
+/* Build a kd-tree of the np points p */
+static boolT kdTreeBuild(const double *p, int np, int dim, delaunaynKdTreeT *tree)
+{
+  int i;
+  tree->nleaf = 1;
+  while (tree->nleaf*2*DELAUNAYN_KD_LEAF_POINTS <= np)
+    tree->nleaf *= 2;
+  tree->rows = (int *) malloc(((size_t) np + 1)*sizeof(int));
+  tree->lo = (double *) malloc((size_t) 2*tree->nleaf*dim*sizeof(double));
+  tree->hi = (double *) malloc((size_t) 2*tree->nleaf*dim*sizeof(double));
+  if (!tree->rows || !tree->lo || !tree->hi)
+    return(False);
+  for (i = 0; i < np; i++)
+    tree->rows[i] = i;
+  kdTreeNode(p, np, dim, tree->rows, np, tree->nleaf, 0, tree);
+  return(True);
+}
+
+static void kdTreeFree(delaunaynKdTreeT *tree)
+{
+  free(tree->rows);
+  free(tree->lo);
+  free(tree->hi);
+}
+
+/* Return True if no points other than the vertices v of a simplex
+   among the n rows of the subtree at node are strictly inside the
+   sphere with centre c and squared radius r2 */
+static boolT kdTreeSphereEmpty(const delaunaynKdTreeT *tree, const double *p, int np, int dim,
+                               const int *v, const double *c, double r2,
+                               const int *rows, int n, int nleaf, int node)
+{
+  int i, j, k;
+  const double *lo = tree->lo + (size_t)node*dim, *hi = tree->hi + (size_t)node*dim;
+  double d2 = 0;
+  for (j = 0; j < dim; j++) {
+    double d = fmax(lo[j] - c[j], fmax(c[j] - hi[j], 0));
+    d2 += d*d;
+  }
+  if (d2 >= r2)
+    return(True);
+  if (nleaf == 1) {
+    for (i = 0; i < n; i++) {
+      for (k = 0; k <= dim; k++)
+        if (rows[i] == v[k])
+          break;
+      if (k > dim && inSphere(p, np, dim, rows[i], c, r2))
+        return(False);
+    }
+    return(True);
+  }
+  return(kdTreeSphereEmpty(tree, p, np, dim, v, c, r2, rows, n/2, nleaf/2, 2*node + 1) &&
+         kdTreeSphereEmpty(tree, p, np, dim, v, c, r2, rows + n/2, n - n/2, nleaf/2, 2*node + 2));
+}
+
+/* Face of a simplex on a seam: the rows of its vertices in increasing
+   order, and the row of the opposite vertex of the simplex */
+typedef struct {
+  int v[3];
+  int opp;
+} delaunaynKdFaceT;
+
+static int faceCompare(const void *a, const void *b)
+{
+  const int *u = ((const delaunaynKdFaceT *) a)->v, *w = ((const delaunaynKdFaceT *) b)->v;
+  for (int j = 0; j < 3; j++)
+    if (u[j] != w[j])
+      return(u[j] < w[j] ? -1 : 1);
+  return(0);
+}
+
+static void faceSet(delaunaynKdFaceT *f, int dim, const int *v, int opp)
+{
+  int i, j;
+  for (i = 0; i < dim; i++) {
+    int x = v[i];
+    for (j = i; j > 0 && f->v[j - 1] > x; j--)
+      f->v[j] = f->v[j - 1];
+    f->v[j] = x;
+  }
+  if (dim == 2)
+    f->v[2] = -1;
+  f->opp = opp;
+}
+
+/* Check the faces on the seams. Each must be shared by two simplices
+   on opposite sides of it with neither opposite vertex inside the
+   circumsphere of the other simplex, or have no points of the hulls
+   of the partitions beyond it. */
+static boolT checkSeamFaces(const delaunaynKdT *kd, delaunaynKdFaceT *faces, size_t nfaces,
+                            const int *hull, int nhull)
+{
+  const double *p = kd->p;
+  int np = kd->np, dim = kd->dim;
+  size_t i, k;
+  qsort(faces, nfaces, sizeof(delaunaynKdFaceT), faceCompare);
+  for (i = 0; i < nfaces; i = k) {
+    for (k = i + 1; k < nfaces && !faceCompare(&faces[i], &faces[k]); k++);
+    int s = orientation(p, np, dim, faces[i].v, faces[i].opp, 0);
+    if (!s)
+      return(False);
+    if (k - i == 1) {
+      /* Face on the convex hull */
+      for (int h = 0; h < nhull; h++)
+        if (orientation(p, np, dim, faces[i].v, hull[h], DELAUNAYN_KD_EPS) == -s)
+          return(False);
+    } else if (k - i == 2) {
+      if (orientation(p, np, dim, faces[i].v, faces[i + 1].opp, 0) != -s)
+        return(False);
+      /* Locally Delaunay */
+      int v[4];
+      double c[3], r2;
+      for (int j = 0; j < dim; j++)
+        v[j] = faces[i].v[j];
+      v[dim] = faces[i].opp;
+      if (!circumsphere(p, np, dim, v, c, &r2) || inSphere(p, np, dim, faces[i + 1].opp, c, r2))
+        return(False);
+      v[dim] = faces[i + 1].opp;
+      if (!circumsphere(p, np, dim, v, c, &r2) || inSphere(p, np, dim, faces[i].opp, c, r2))
+        return(False);
+    } else {
+      return(False);
+    }
+  }
+  return(True);
+}
+
+/* Delaunay triangulation of the points p by triangulating partitions
+   of them in nthreads threads; see above. If spatialSort is TRUE, the
+   points of each partition are sorted as in qhullNewQhull(). Returns
+   a list with the element tri, as returned by C_delaunayn(), or NULL
+   if the points should be triangulated by C_delaunayn(), as they
+   always are without OpenMP, when the partitions would be
+   triangulated one after another. */
+SEXP C_delaunayn_kd(const SEXP p, const SEXP options, const SEXP nthreads, const SEXP spatialSort)
+{
+  if(!Rf_isMatrix(p) || !Rf_isReal(p)){
+    Rf_error("First argument should be a real matrix.");
+  }
+  if(!Rf_isString(options) || Rf_length(options) != 1){
+    Rf_error("Options must be a single string.");
+  }
+  if (LENGTH(STRING_ELT(options, 0)) > 200)
+    Rf_error("Option string too long");
+
+#ifndef _OPENMP
+  return(R_NilValue);
+#endif
+
+  const int np = Rf_nrows(p);
+  const int dim = Rf_ncols(p);
+  const int nt = INTEGER(nthreads)[0];
+  int npart = 1;
+  while (npart < nt)
+    npart *= 2;
+  if (dim < 2 || dim > 3 || npart < 2 || np < npart*DELAUNAYN_KD_MIN_POINTS)
+    return(R_NilValue);
+
+  char flags[250], flags_simplex[250];
+  snprintf(flags, 249, "qhull d Qbb T0 %s", CHAR(STRING_ELT(options, 0)));
+  snprintf(flags_simplex, 249, "qhull d Qbb T0 Qz %s", CHAR(STRING_ELT(options, 0)));
+
+  delaunaynKdT kd;
+  kd.p = REAL(p);
+  kd.np = np;
+  kd.dim = dim;
+  kd.npart = npart;
+  kd.lo = (double *) R_alloc(npart*dim, sizeof(double));
+  kd.hi = (double *) R_alloc(npart*dim, sizeof(double));
+  for (int i = 0; i < npart*dim; i++) {
+    kd.lo[i] = -HUGE_VAL;
+    kd.hi[i] = HUGE_VAL;
+  }
+  kd.seam = (char *) R_alloc(np, sizeof(char));
+  memset(kd.seam, 0, np);
+  kd.part = (delaunaynKdPartT *) R_alloc(npart, sizeof(delaunaynKdPartT));
+  memset(kd.part, 0, npart*sizeof(delaunaynKdPartT));
+
+  int *rows = (int *) R_alloc(np, sizeof(int));
+  int *offsets = (int *) R_alloc(npart + 1, sizeof(int));
+  for (int i = 0; i < np; i++)
+    rows[i] = i;
+  kdPartition(kd.p, np, dim, rows, np, npart, offsets, kd.lo, kd.hi);
+  boolT sort = Rf_asLogical(spatialSort) == TRUE;
+  if (sort) {
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(nt)
+#endif
+    for (int g = 0; g < npart; g++)
+      qhullSpatialSort(kd.p, 1, np, dim, rows + offsets[g], offsets[g + 1] - offsets[g]);
+  }
+
+  /* Triangulate the partitions */
+  qhullBatchT *res = (qhullBatchT *) R_alloc(npart, sizeof(qhullBatchT));
+  char errstr[ERRSTRSIZE];
+  boolT ok = True, interrupted = False;
+  if (qhullBatch(kd.p, np, dim, rows, offsets, npart, flags, flags_simplex, nt,
+                 delaunaynKdExtract, &kd, res, errstr))
+    ok = False, interrupted = True;
+  int nacc = 0, nopen = 0, nhull = 0, g, i, j, k;
+  for (g = 0; g < npart; g++) {
+    if (res[g].exitcode)
+      ok = False;
+    nacc += kd.part[g].nacc;
+    nopen += kd.part[g].nopen;
+    nhull += kd.part[g].nhull;
+  }
+
+  /* Triangulate the points on the seams */
+  int nseam = 0;
+  qhullBatchT seamres;
+  memset(&seamres, 0, sizeof(qhullBatchT));
+  if (ok) {
+    for (i = 0; i < np; i++)
+      if (kd.seam[i])
+        rows[nseam++] = i;
+    int seamoffsets[2] = {0, nseam};
+    if (sort)
+      qhullSpatialSort(kd.p, 1, np, dim, rows, nseam);
+    if (nseam > np/2)
+      ok = False;
+    else if (qhullBatch(kd.p, np, dim, rows, seamoffsets, 1, flags, flags_simplex, 1,
+                        delaunaynBatchExtract, NULL, &seamres, errstr))
+      ok = False, interrupted = True;
+    else if (seamres.exitcode)
+      ok = False;
+  }
+
+  /* Select the simplices on the seams that are not inside one cell
+     and have no points in their circumspheres */
+  char *keep = NULL;
+  delaunaynKdTreeT tree;
+  memset(&tree, 0, sizeof(delaunaynKdTreeT));
+  if (ok && !kdTreeBuild(kd.p, np, dim, &tree))
+    ok = False;
+  if (ok) {
+    keep = (char *) R_alloc(seamres.nf + 1, sizeof(char));
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(nt) schedule(dynamic, 256)
+#endif
+    for (int s = 0; s < seamres.nf; s++) {
+      int v[4];
+      double c[3], r2;
+      keep[s] = 0;
+      for (int j = 0; j <= dim; j++)
+        v[j] = seamres.facets[(dim + 1)*s + j] - 1;
+      if (!circumsphere(kd.p, np, dim, v, c, &r2))
+        continue;
+      int h;
+      for (h = 0; h < npart; h++)
+        if (sphereInBox(dim, c, r2, kd.lo + h*dim, kd.hi + h*dim))
+          break;
+      if (h == npart && kdTreeSphereEmpty(&tree, kd.p, np, dim, v, c, r2,
+                                          tree.rows, np, tree.nleaf, 0))
+        keep[s] = 1;
+    }
+  }
+  kdTreeFree(&tree);
+
+  /* Check the faces on the seams */
+  int nkeep = 0;
+  if (ok) {
+    for (i = 0; i < seamres.nf; i++)
+      nkeep += keep[i];
+    delaunaynKdFaceT *faces = (delaunaynKdFaceT *)
+      malloc(((size_t) nopen + (size_t) nkeep*(dim + 1) + 1)*sizeof(delaunaynKdFaceT));
+    int *hull = (int *) malloc(((size_t) nhull + 1)*sizeof(int));
+    if (!faces || !hull) {
+      ok = False;
+    } else {
+      size_t nfaces = 0;
+      for (g = 0; g < npart; g++)
+        for (i = 0; i < kd.part[g].nopen; i++) {
+          int *f = kd.part[g].open + (dim + 1)*i;
+          faceSet(&faces[nfaces++], dim, f, f[dim]);
+        }
+      for (i = 0; i < seamres.nf; i++) {
+        if (!keep[i])
+          continue;
+        int v[4], w[3];
+        for (j = 0; j <= dim; j++)
+          v[j] = seamres.facets[(dim + 1)*i + j] - 1;
+        for (j = 0; j <= dim; j++) {
+          int l = 0;
+          for (k = 0; k <= dim; k++)
+            if (k != j)
+              w[l++] = v[k];
+          faceSet(&faces[nfaces++], dim, w, v[j]);
+        }
+      }
+      k = 0;
+      for (g = 0; g < npart; g++)
+        for (i = 0; i < kd.part[g].nhull; i++)
+          hull[k++] = kd.part[g].hull[i];
+      ok = checkSeamFaces(&kd, faces, nfaces, hull, nhull);
+    }
+    free(faces);
+    free(hull);
+  }
+
+  /* Copy the simplices to R */
+  SEXP retlist = R_NilValue;
+  if (ok) {
+    SEXP tri, retnames;
+    tri = PROTECT(Rf_allocMatrix(INTSXP, nacc + nkeep, dim + 1));
+    int *ptri = INTEGER(tri);
+    int ntri = nacc + nkeep;
+    k = 0;
+    for (g = 0; g < npart; g++)
+      for (i = 0; i < kd.part[g].nacc; i++, k++)
+        for (j = 0; j <= dim; j++)
+          ptri[k + (size_t)ntri*j] = kd.part[g].acc[(dim + 1)*i + j] + 1;
+    for (i = 0; i < seamres.nf; i++) {
+      if (!keep[i])
+        continue;
+      for (j = 0; j <= dim; j++)
+        ptri[k + (size_t)ntri*j] = seamres.facets[(dim + 1)*i + j];
+      k++;
+    }
+    retlist = PROTECT(Rf_allocVector(VECSXP, 1));
+    retnames = PROTECT(Rf_allocVector(STRSXP, 1));
+    SET_VECTOR_ELT(retlist, 0, tri);
+    SET_STRING_ELT(retnames, 0, Rf_mkChar("tri"));
+    Rf_setAttrib(retlist, R_NamesSymbol, retnames);
+    UNPROTECT(3);
+  }
+
+  for (g = 0; g < npart; g++) {
+    free(kd.part[g].acc);
+    free(kd.part[g].open);
+    free(kd.part[g].hull);
+  }
+  free(seamres.facets);
+
+  if (interrupted)
+    Rf_error("Interrupted");
+  return(retlist);
+}
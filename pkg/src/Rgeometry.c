@@ -2,7 +2,9 @@
 #include <Rdefines.h>
 #include <Rinternals.h>
 #include "qhull_ra.h"
-#include <unistd.h>              /* For unlink() */
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
 
 void freeQhull(qhT *qh) {
   int curlong, totlong;
@@ -26,6 +28,25 @@ void qhullFinalizer(SEXP ptr)
   R_ClearExternalPtr(ptr); /* not really needed */
 }
 
+/* Return the number of bytes held by the Qhull structure pointed to
+   by ptr, as attached by convhulln() or delaunayn(), or 0 if there is
+   none. This comprises the structure itself, the long memory and the
+   buffers of short memory in use by Qhull, and any copies of the
+   points that Qhull has made. */
+SEXP C_qhull_memory(const SEXP ptr)
+{
+  double bytes = 0;
+  if (TYPEOF(ptr) == EXTPTRSXP && R_ExternalPtrAddr(ptr)) {
+    qhT *qh = R_ExternalPtrAddr(ptr);
+    bytes = sizeof(qhT) + (double) qh->qhmem.totlong + qh->qhmem.totbuffer;
+    if (qh->POINTSmalloc)
+      bytes += (double) qh->num_points*qh->hull_dim*sizeof(coordT);
+    if (qh->input_malloc)
+      bytes += (double) qh->num_points*qh->hull_dim*sizeof(coordT);
+  }
+  return Rf_ScalarReal(bytes);
+}
+
 boolT hasPrintOption(qhT *qh, qh_PRINT format) {
   for (int i=0; i < qh_PRINTEND; i++) {
     if (qh->PRINTout[i] == format) {
@@ -35,24 +56,139 @@ boolT hasPrintOption(qhT *qh, qh_PRINT format) {
   return(False);
 }
 
-int qhullNewQhull(qhT *qh, const SEXP p, char* cmd, const SEXP options, const SEXP tmp_stdout, const SEXP tmp_stderr, unsigned int* pdim, unsigned int* pn, char errstr[ERRSTRSIZE]) {
+/* Return True if flags contain the Qhull option TO, which redirects
+   the output of Qhull to a file */
+static boolT hasOutputFileOption(const char *flags) {
+  const char *s;
+  for (s = strstr(flags, "TO"); s; s = strstr(s + 1, "TO")) {
+    if ((s == flags || isspace((unsigned char) s[-1])) &&
+        isspace((unsigned char) s[2]))
+      return(True);
+  }
+  return(False);
+}
+
+/* Return True if Qhull, run with the option string flags, may modify
+   the coordinates of the input points in place. This is the case for
+   the options Qbb, QbB, Qbk:n, QBk:n and QRn, unless Qhull works on a
+   projection of the points, as it does for Delaunay triangulations
+   (d and v) and halfspace intersections (H). Several Q options can
+   be run together, e.g. QbbQc, so any Q option containing b, B or R
+   is assumed to modify the points. */
+boolT qhullModifiesInput(const char *flags) {
+  const char *s = flags;
+  boolT modifies = False;
+  while (*s) {
+    while (isspace((unsigned char) *s))
+      s++;
+    if (*s == 'd' || *s == 'v' || *s == 'H')
+      return(False);
+    if (*s == 'Q') {
+      for (; *s && !isspace((unsigned char) *s); s++)
+        if (*s == 'b' || *s == 'B' || *s == 'R')
+          modifies = True;
+    }
+    while (*s && !isspace((unsigned char) *s))
+      s++;
+  }
+  return(modifies);
+}
+
+/* Copy the column-major n-by-dim matrix x to the row-major matrix y.
+   The rows are copied in blocks, so that the block of y being written
+   stays in the cache while each column of x is read sequentially. */
+#define TRANSPOSE_BLOCK 256
+static void transposeToRowMajor(const double *x, int n, int dim, double *y) {
+  int i, i0, i1, j;
+  for (i0 = 0; i0 < n; i0 += TRANSPOSE_BLOCK) {
+    i1 = i0 + TRANSPOSE_BLOCK < n ? i0 + TRANSPOSE_BLOCK : n;
+    for (j = 0; j < dim; j++) {
+      const double *xj = x + (size_t)n*j;
+      for (i = i0; i < i1; i++)
+        y[(size_t)dim*i + j] = xj[i];
+    }
+  }
+}
+
+/* Key of a point on the Morton curve, and its row */
+typedef struct {
+  uint64_t key;
+  int row;
+} mortonKeyT;
+
+static int mortonKeyCompare(const void *a, const void *b) {
+  const mortonKeyT *ka = (const mortonKeyT *) a, *kb = (const mortonKeyT *) b;
+  if (ka->key != kb->key)
+    return(ka->key < kb->key ? -1 : 1);
+  return(ka->row - kb->row);
+}
+
+/* Sort the 0-based rows[0], ..., rows[n - 1] of the points p along
+   a Morton (Z-order) curve through their bounding box, so that points
+   that are close in space are close in memory once they are copied in
+   this order. Coordinate j of point i is p[si*i + sj*j]. Only the
+   first 64 coordinates are used. If there is not enough memory, rows
+   is left as it is. */
+void qhullSpatialSort(const double *p, size_t si, size_t sj, int dim, int *rows, int n) {
+  int i, j, b;
+  int nd = dim < 64 ? dim : 64;
+  int nb = 64/nd < 32 ? 64/nd : 32;
+  double lo[64], scale[64];
+  for (j = 0; j < nd; j++) {
+    double mn = HUGE_VAL, mx = -HUGE_VAL;
+    for (i = 0; i < n; i++) {
+      double x = p[si*rows[i] + sj*j];
+      mn = fmin(mn, x);
+      mx = fmax(mx, x);
+    }
+    lo[j] = mn;
+    scale[j] = mx > mn ? (ldexp(1, nb) - 1)/(mx - mn) : 0;
+  }
+  mortonKeyT *keys = (mortonKeyT *) malloc(((size_t) n + 1)*sizeof(mortonKeyT));
+  if (!keys)
+    return;
+  for (i = 0; i < n; i++) {
+    uint64_t c[64], key = 0;
+    for (j = 0; j < nd; j++)
+      c[j] = (uint64_t) ((p[si*rows[i] + sj*j] - lo[j])*scale[j]);
+    for (b = nb - 1; b >= 0; b--)
+      for (j = 0; j < nd; j++)
+        key = (key << 1) | ((c[j] >> b) & 1);
+    keys[i].key = key;
+    keys[i].row = rows[i];
+  }
+  qsort(keys, n, sizeof(mortonKeyT), mortonKeyCompare);
+  for (i = 0; i < n; i++)
+    rows[i] = keys[i].row;
+  free(keys);
+}
+
+/* Run Qhull with the command cmd and the options on the points
+   p. Normally p is an n-by-dim matrix with one point in each row. If
+   transposed is True, p is a dim-by-n matrix with one point in each
+   column, which is the layout that Qhull uses, so that unless Qhull
+   would modify the points, they are used without being copied. In
+   that case the caller must keep p alive for as long as qh is.
+
+   If porder is not NULL, the points are passed to Qhull sorted along
+   a space-filling curve, which makes Qhull's accesses to them more
+   local, and *porder is set to the 0-based rows of p in that order,
+   so that the point with Qhull ID i is row (*porder)[i] of p. */
+int qhullNewQhull(qhT *qh, const SEXP p, char* cmd, const SEXP options, boolT transposed, int **porder, unsigned int* pdim, unsigned int* pn, char errstr[ERRSTRSIZE]) {
   unsigned int dim, n;
   int exitcode = 1; 
   boolT ismalloc;
   char flags[250];             /* option flags for qhull, see qh_opt.htm */
   double *pt_array;
-  int i, j;
+  int i;
   
-  /* We cannot print directly to stdout in R, and the alternative of
-     using R_Outputfile does not seem to work for all architectures.
-     Setting outfile to NULL is not an option, as an open file handle
-     is required for a call to freopen in the Qhull code when
-     qh_new_qhull() is called. Therefore use the ersatz stdout,
-     tmpstdout (see below). */
-  /* qh_fprintf() in userprint.c has been redefined so that a NULL
-     errfile results in printing via REprintf(). */
-  FILE *tmpstdout = NULL;
-  FILE *errfile = NULL;       
+  /* We cannot print directly to stdout in R. Qhull only writes to its
+     output file when asked to with the option TO, so otherwise no
+     output file is given. Qhull's error output is sent to the fake
+     stderr qh_FILEstderr, which qh_fprintf() in userprintf_r.c has
+     been redefined to append to the buffer qh->cpp_user, here
+     errstr, so that no files are needed. */
+  FILE *outfile = NULL;
 
   if(!Rf_isString(options) || Rf_length(options) != 1){
     Rf_error("Second argument must be a single string.");
@@ -68,42 +204,228 @@ int qhullNewQhull(qhT *qh, const SEXP p, char* cmd, const SEXP options, const SE
   snprintf(flags, 249, "%s %s", cmd, CHAR(STRING_ELT(options,0)));
 
   /* Check input matrix */
-  dim = Rf_ncols(p);
-  n   = Rf_nrows(p);
+  dim = transposed ? Rf_nrows(p) : Rf_ncols(p);
+  n   = transposed ? Rf_ncols(p) : Rf_nrows(p);
   if(dim <= 0 || n <= 0){
     Rf_error("Invalid input matrix.");
   }
 
-  pt_array = (double *) R_alloc(n*dim, sizeof(double)); 
-  for(i=0; i < n; i++)
-    for(j=0; j < dim; j++)
-      pt_array[dim*i+j] = REAL(p)[i+n*j]; /* could have been pt_array = REAL(p) if p had been transposed */
+  if (porder) {
+    int *order = (int *) R_alloc(n, sizeof(int));
+    for (i = 0; i < n; i++)
+      order[i] = i;
+    size_t si = transposed ? dim : 1, sj = transposed ? 1 : n;
+    qhullSpatialSort(REAL(p), si, sj, dim, order, n);
+    pt_array = (double *) R_alloc((size_t) n*dim, sizeof(double));
+    for (i = 0; i < n; i++)
+      for (unsigned int j = 0; j < dim; j++)
+        pt_array[(size_t)dim*i + j] = REAL(p)[si*order[i] + sj*j];
+    *porder = order;
+  } else if (transposed && !qhullModifiesInput(flags)) {
+    pt_array = REAL(p);
+  } else {
+    pt_array = (double *) R_alloc((size_t) n*dim, sizeof(double));
+    if (transposed)
+      memcpy(pt_array, REAL(p), (size_t) n*dim*sizeof(double));
+    else
+      transposeToRowMajor(REAL(p), n, dim, pt_array);
+  }
 
   ismalloc = False; /* True if qhull should free points in qh_freeqhull() or reallocation */
 
-  /* Jiggery-pokery to create and destroy the ersatz stdout, and the
-     call to qhull itself. */    
-  const char *name, *errname;
-  name = CHAR(STRING_ELT(tmp_stdout, 0));
-  tmpstdout = fopen(name, "w");
-  errname = CHAR(STRING_ELT(tmp_stderr, 0));
-  errfile = fopen(errname, "w+");
-  qh_zero(qh, errfile);
-  exitcode = qh_new_qhull (qh, dim, n, pt_array, ismalloc, flags, tmpstdout, errfile);
-  fclose(tmpstdout);
-  unlink(name);
-  rewind(errfile);
-  char buf[200];
-  errstr[0] = '\0';
-  while(fgets(buf, sizeof(buf), errfile) != NULL &&
-        (ERRSTRSIZE - strlen(errstr) - 1) > 0) {
-    errstr = strncat(errstr, buf, ERRSTRSIZE - strlen(errstr) - 1);
+  /* The option TO reopens the output file as the named file, so an
+     open file is needed, which is closed after the call to Qhull */
+  if (hasOutputFileOption(flags)) {
+    outfile = tmpfile();
+    if (outfile == NULL)
+      Rf_error("Unable to open temporary file for Qhull output");
   }
-  
-  fclose(errfile);
-  unlink(errname);
+
+  errstr[0] = '\0';
+  qh_zero(qh, qh_FILEstderr);
+  qh->cpp_user = errstr;
+  exitcode = qh_new_qhull (qh, dim, n, pt_array, ismalloc, flags, outfile, qh_FILEstderr);
+  /* errstr belongs to the caller, so later messages are printed with
+     REprintf() */
+  qh->cpp_user = NULL;
+  if (outfile)
+    fclose(outfile);
 
   *pdim = dim;
   *pn = n;
   return(exitcode);
 }
+
+/* Functions for running Qhull on many groups of points in one call,
+   possibly in several threads. Apart from qhullBatch() and
+   qhullBatchResult(), which must be called from the main R thread,
+   they do not use the R API, so can be called from any thread. */
+
+/* Number of threads to use for ngroups groups */
+static int qhullBatchThreads(int nthreads, int ngroups) {
+#ifdef _OPENMP
+  if (nthreads > ngroups)
+    nthreads = ngroups;
+  return(nthreads < 1 ? 1 : nthreads);
+#else
+  return(1);
+#endif
+}
+
+/* Run Qhull with the option string flags on the n points of the
+   column-major np-by-dim matrix p whose 0-based row indices are
+   rows[0], ..., rows[n - 1]. work must have space for n*dim
+   doubles. qh must either be new or have been freed with
+   qhullBatchFree(). Qhull's error output is written to errstr, which
+   is used until qhullBatchFree() is called. */
+static int qhullBatchRun(qhT *qh, const double *p, int np, int dim, const int *rows, int n, char *flags, double *work, char errstr[ERRSTRSIZE]) {
+  int i, j;
+  for (i = 0; i < n; i++)
+    for (j = 0; j < dim; j++)
+      work[dim*i + j] = p[rows[i] + (size_t)np*j];
+
+  errstr[0] = '\0';
+  qh_zero(qh, qh_FILEstderr);
+  qh->cpp_user = errstr;
+  return(qh_new_qhull(qh, dim, n, work, False, flags, NULL, qh_FILEstderr));
+}
+
+/* Free the memory used by Qhull, without freeing qh itself, so that
+   it can be used for the next group. The short memory has to be
+   freed too, as qh_new_qhull() allocates it afresh. */
+static void qhullBatchFree(qhT *qh) {
+  int curlong, totlong;
+  qh_freeqhull(qh, !qh_ALL);
+  qh_memfreeshort(qh, &curlong, &totlong);
+  qh->cpp_user = NULL;
+}
+
+static void checkInterruptFn(void *dummy) {
+  R_CheckUserInterrupt();
+}
+
+/* Return True if the user has interrupted R. Unlike
+   R_CheckUserInterrupt(), this returns, so that memory can be freed
+   before stopping. */
+static boolT qhullBatchInterrupted(void) {
+  return(R_ToplevelExec(checkInterruptFn, NULL) == FALSE);
+}
+
+/* Run Qhull on the groups of rows of the column-major np-by-dim
+   matrix p. The 0-based rows of group g are rows[offsets[g]], ...,
+   rows[offsets[g + 1] - 1]. Qhull is run with the option string
+   flags, or flags_simplex, if it is not NULL and the group has dim +
+   1 points. After each run, extract() is called with data to fill in
+   res[g] from qh; it should set res[g].exitcode to non-zero if the
+   group has failed. The groups are run in up to nthreads threads,
+   each with one qhT that is reused for all of its groups. The Qhull error message
+   of the first group to fail is written to errstr. Returns True if
+   the user interrupted R, in which case res has been freed. */
+boolT qhullBatch(const double *p, int np, int dim, const int *rows, const int *offsets, int ng,
+                 const char *flags, const char *flags_simplex, int nthreads,
+                 qhullBatchExtractFn extract, void *data, qhullBatchT *res, char errstr[ERRSTRSIZE]) {
+  int g, maxn = 0;
+  for (g = 0; g < ng; g++)
+    if (offsets[g + 1] - offsets[g] > maxn)
+      maxn = offsets[g + 1] - offsets[g];
+  memset(res, 0, ng*sizeof(qhullBatchT));
+  errstr[0] = '\0';
+  int errgroup = -1;
+  int nt = qhullBatchThreads(nthreads, ng);
+  boolT interrupted = False;
+
+  for (int start = 0; start < ng && !interrupted; start += QHULL_BATCH_CHUNK*nt) {
+    int end = start + QHULL_BATCH_CHUNK*nt;
+    if (end > ng)
+      end = ng;
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(nt)
+#endif
+    {
+      qhT *qh = (qhT *) malloc(sizeof(qhT));
+      double *work = (double *) malloc(((size_t) maxn*dim + 1)*sizeof(double));
+      /* Qhull may modify its option string, so each thread has its own */
+      char flags_t[250], flags_simplex_t[250], errstr_t[ERRSTRSIZE];
+      strncpy(flags_t, flags, 249);
+      flags_t[249] = '\0';
+      strncpy(flags_simplex_t, flags_simplex ? flags_simplex : flags, 249);
+      flags_simplex_t[249] = '\0';
+
+#ifdef _OPENMP
+      #pragma omp for schedule(dynamic)
+#endif
+      for (int g = start; g < end; g++) {
+        int n = offsets[g + 1] - offsets[g];
+        if (!qh || !work) {
+          res[g].exitcode = qh_ERRmem;
+          continue;
+        }
+        int exitcode = qhullBatchRun(qh, p, np, dim, rows + offsets[g], n,
+                                     n == dim + 1 ? flags_simplex_t : flags_t, work, errstr_t);
+        res[g].exitcode = exitcode;
+        extract(qh, exitcode, g, rows + offsets[g], n, dim, data, &res[g]);
+        if (res[g].exitcode) {
+#ifdef _OPENMP
+          #pragma omp critical
+#endif
+          if (errgroup < 0 || g < errgroup) {
+            errgroup = g;
+            strcpy(errstr, errstr_t);
+          }
+        }
+        qhullBatchFree(qh);
+      }
+      free(work);
+      free(qh);
+    }
+
+    interrupted = qhullBatchInterrupted();
+  }
+
+  if (interrupted)
+    for (g = 0; g < ng; g++) {
+      free(res[g].facets);
+      res[g].facets = NULL;
+    }
+  return(interrupted);
+}
+
+/* Return a list containing the facets of all the groups in res in the
+   matrix element name, which has width columns, the offsets of the
+   facets of each group in the matrix, the exit codes of the groups
+   and the error message errstr. The facets in res are freed. */
+SEXP qhullBatchResult(qhullBatchT *res, int ng, int width, const char *name, const char *errstr) {
+  int g, i, j, k = 0, nftot = 0;
+  for (g = 0; g < ng; g++)
+    nftot += res[g].nf;
+
+  SEXP facets, offsets, exitcode, retlist, retnames;
+  facets = PROTECT(Rf_allocMatrix(INTSXP, nftot, width));
+  offsets = PROTECT(Rf_allocVector(INTSXP, ng + 1));
+  exitcode = PROTECT(Rf_allocVector(INTSXP, ng));
+  for (g = 0; g < ng; g++) {
+    INTEGER(offsets)[g] = k;
+    for (i = 0; i < res[g].nf; i++, k++)
+      for (j = 0; j < width; j++)
+        INTEGER(facets)[k + (size_t)nftot*j] = res[g].facets[width*i + j];
+    free(res[g].facets);
+    res[g].facets = NULL;
+    INTEGER(exitcode)[g] = res[g].exitcode;
+  }
+  INTEGER(offsets)[ng] = k;
+
+  retlist = PROTECT(Rf_allocVector(VECSXP, 4));
+  retnames = PROTECT(Rf_allocVector(STRSXP, 4));
+  SET_VECTOR_ELT(retlist, 0, facets);
+  SET_STRING_ELT(retnames, 0, Rf_mkChar(name));
+  SET_VECTOR_ELT(retlist, 1, offsets);
+  SET_STRING_ELT(retnames, 1, Rf_mkChar("offsets"));
+  SET_VECTOR_ELT(retlist, 2, exitcode);
+  SET_STRING_ELT(retnames, 2, Rf_mkChar("exitcode"));
+  SET_VECTOR_ELT(retlist, 3, Rf_mkString(errstr));
+  SET_STRING_ELT(retnames, 3, Rf_mkChar("error"));
+  Rf_setAttrib(retlist, R_NamesSymbol, retnames);
+  UNPROTECT(5);
+  return(retlist);
+}
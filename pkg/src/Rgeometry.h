@@ -1,4 +1,7 @@
 /* This file is included via Makevars in all C files */
+#ifndef RGEOMETRY_H
+#define RGEOMETRY_H
+
 #include <R.h>
 #include <Rdefines.h>
 #include <Rinternals.h>
@@ -22,5 +25,34 @@
 
 void freeQhull(qhT *qh);
 void qhullFinalizer(SEXP ptr);
+SEXP C_qhull_memory(const SEXP ptr);
 boolT hasPrintOption(qhT *qh, qh_PRINT format);
-int qhullNewQhull(qhT *qh, const SEXP p, char* cmd, const SEXP options, const SEXP tmp_stdout, const SEXP tmp_stderr, unsigned int* pdim, unsigned int* pn, char errstr[1000]);
+boolT qhullModifiesInput(const char *flags);
+int qhullNewQhull(qhT *qh, const SEXP p, char* cmd, const SEXP options, boolT transposed, int **porder, unsigned int* pdim, unsigned int* pn, char errstr[ERRSTRSIZE]);
+/* Row of p of the point with the Qhull ID id, given the order set by
+   qhullNewQhull() */
+#define qhullPointRow(order, id) ((order) ? (order)[id] : (id))
+void qhullSpatialSort(const double *p, size_t si, size_t sj, int dim, int *rows, int n);
+
+/* Number of groups run by each thread between checks for user
+   interrupts in qhullBatch() */
+#define QHULL_BATCH_CHUNK 256
+
+/* Result for one group of points in qhullBatch() */
+typedef struct {
+  int exitcode;                 /* Exit code from Qhull */
+  int nf;                       /* Number of facets */
+  int *facets;                  /* Indices of the points of each facet, row-major */
+  double area, vol;             /* Generalised area and volume */
+} qhullBatchT;
+
+/* Function to extract the result for group g of points in
+   qhullBatch(). data is passed through from qhullBatch(). */
+typedef void (*qhullBatchExtractFn)(qhT *qh, int exitcode, int g, const int *rows, int n, int dim, void *data, qhullBatchT *res);
+
+boolT qhullBatch(const double *p, int np, int dim, const int *rows, const int *offsets, int ng,
+                 const char *flags, const char *flags_simplex, int nthreads,
+                 qhullBatchExtractFn extract, void *data, qhullBatchT *res, char errstr[ERRSTRSIZE]);
+SEXP qhullBatchResult(qhullBatchT *res, int ng, int width, const char *name, const char *errstr);
+
+#endif /* RGEOMETRY_H */
@@ -17,9 +17,8 @@
 
 #include "Rgeometry.h"
 #include "qhull_ra.h"
-#include <unistd.h>              /* For unlink() */
 
-SEXP C_halfspacen(const SEXP p, const SEXP options, const SEXP tmp_stdout, const SEXP tmp_stderr)
+SEXP C_halfspacen(const SEXP p, const SEXP options)
 {
   /* Return value*/
   SEXP retval;
@@ -29,7 +28,7 @@ SEXP C_halfspacen(const SEXP p, const SEXP options, const SEXP tmp_stdout, const
   char errstr[ERRSTRSIZE];
   unsigned int dim, n;
   char cmd[50] = "qhull H";
-  int exitcode = qhullNewQhull(qh, p, cmd,  options, tmp_stdout, tmp_stdout, &dim, &n, errstr);
+  int exitcode = qhullNewQhull(qh, p, cmd,  options, False, NULL, &dim, &n, errstr);
 
   /* If error */
   if (exitcode) {
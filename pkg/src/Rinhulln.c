@@ -33,6 +33,10 @@ SEXP C_inhulln(const SEXP ch, const SEXP p)
   }
   qh = R_ExternalPtrAddr(ptr);
   UNPROTECT(2);
+  /* The hull is not restored if the object has been saved and loaded */
+  if (qh == NULL) {
+    Rf_error("Qhull structure of convex hull is no longer available");
+  }
   
   /* Initialise return value */
   SEXP inside;
@@ -70,3 +74,737 @@ SEXP C_inhulln(const SEXP ch, const SEXP p)
   
   return inside;
 }
+
+/* Signed distance of point x from the plane p, comprising the normal
+   and offset of a facet, computed in the same order as
+   qh_distplane() */
+static inline double planeDist(const double *p, const double *x, int dim)
+{
+  double dist = p[dim];
+  for (int k = 0; k < dim; k++)
+    dist += x[k]*p[k];
+  return(dist);
+}
+
+/* Number of threads to use for n points */
+static int inhullnThreads(int nthreads, int n) {
+#ifdef _OPENMP
+  if (nthreads > n)
+    nthreads = n;
+  return(nthreads < 1 ? 1 : nthreads);
+#else
+  return(1);
+#endif
+}
+
+/* Number of points in each block of points divided between threads */
+#define INHULLN_BLOCK 4096
+
+/* Test if the points in rows start to end - 1 of the n-by-dim matrix
+   p are in the hull with nf facets described by the planes pl and the
+   nf-by-nn matrix of neighbours nb, setting the corresponding
+   elements of inside. point must have room for dim doubles. As in
+   qh_findbestfacet(), the search starts by walking from facet to
+   facet in the direction of increasing distance, starting from the
+   facet found for the previous point. A point is outside the hull if
+   it is at least tol away from a facet, so if the walk stops at a
+   facet closer than this, all the facets are checked. The hull is
+   only read, so several threads can search it at once. */
+static void inhullnWalk(const double *pl, const int *nb, int nf, int nn, double tol,
+                        const double *p, int n, int dim, int start, int end,
+                        double *point, int *inside)
+{
+  int i, j, f, best = 0;
+  double dist, bestdist;
+  for (i = start; i < end; i++) {
+    for (j = 0; j < dim; j++)
+      point[j] = p[i + (size_t)n*j];
+    if (nf == 0) {
+      inside[i] = FALSE;
+      continue;
+    }
+    /* Walk uphill from the previous best facet */
+    bestdist = planeDist(pl + (size_t)(dim + 1)*best, point, dim);
+    f = best;
+    while (bestdist < tol) {
+      for (j = 0; j < nn; j++) {
+        int g = nb[f + (size_t)nf*j];
+        if (g == NA_INTEGER)
+          break;
+        dist = planeDist(pl + (size_t)(dim + 1)*(g - 1), point, dim);
+        if (dist > bestdist) {
+          bestdist = dist;
+          best = g - 1;
+        }
+      }
+      if (best == f)
+        break;
+      f = best;
+    }
+    /* Check all the facets if the walk has not found the point to be
+       outside */
+    for (f = 0; f < nf && bestdist < tol; f++) {
+      dist = planeDist(pl + (size_t)(dim + 1)*f, point, dim);
+      if (dist > bestdist) {
+        bestdist = dist;
+        best = f;
+      }
+    }
+    inside[i] = bestdist < tol;
+  }
+}
+
+/* Test if the points p are in the hull described by the flat index
+   produced by C_convhulln_index(), using inhullnWalk(). As in
+   C_inhulln_scan(), the points are divided into blocks, which are
+   tested in nthreads threads. */
+SEXP C_inhulln_index(const SEXP planes, const SEXP neighbours, const SEXP tolerance, const SEXP p,
+                     const SEXP nthreads)
+{
+  if(!Rf_isMatrix(p) || !Rf_isReal(p)){
+    Rf_error("Second argument should be a real matrix.");
+  }
+  int dim = Rf_ncols(p), n = Rf_nrows(p);
+  int nf = Rf_ncols(planes), nn = Rf_ncols(neighbours);
+  if (Rf_nrows(planes) != dim + 1) {
+    Rf_error("Number of columns in test points p (%d) not equal to dimension of hull (%d).", dim, Rf_nrows(planes) - 1);
+  }
+
+  SEXP inside = PROTECT(Rf_allocVector(LGLSXP, n));
+  const double *pl = REAL(planes), *pp = REAL(p);
+  const int *nb = INTEGER(neighbours);
+  int *in = LOGICAL(inside);
+  double tol = Rf_asReal(tolerance);
+  int nblocks = (n + INHULLN_BLOCK - 1)/INHULLN_BLOCK;
+  int nt = inhullnThreads(Rf_asInteger(nthreads), nblocks);
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(nt)
+#endif
+  {
+    double *point = (double *) malloc((dim + 1)*sizeof(double));
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+#endif
+    for (int b = 0; b < nblocks; b++) {
+      int start = b*INHULLN_BLOCK, end = b == nblocks - 1 ? n : start + INHULLN_BLOCK;
+      if (point)
+        inhullnWalk(pl, nb, nf, nn, tol, pp, n, dim, start, end, point, in);
+      else
+        for (int i = start; i < end; i++)
+          in[i] = NA_LOGICAL;
+    }
+    free(point);
+  }
+  UNPROTECT(1);
+
+  return inside;
+}
+
+/* Number of facets checked by C_inhulln_scan() between early exits */
+#define INHULLN_SCAN_CHUNK 16
+
+/* Return 1 if the point x is outside any of a chunk of facets, whose
+   planes are arranged as in C_inhulln_scan(). When inlined with a
+   constant dim, the loop over the facets can be vectorised. The
+   distances are computed in the same order as in planeDist(). */
+static inline int scanChunkOutside(const double *pt, size_t nfp, const double *x, int dim, double tol)
+{
+  int outside = 0;
+#ifdef _OPENMP
+  #pragma omp simd reduction(|:outside)
+#endif
+  for (int f = 0; f < INHULLN_SCAN_CHUNK; f++) {
+    double dist = pt[dim*nfp + f];
+    for (int k = 0; k < dim; k++)
+      dist += x[k]*pt[k*nfp + f];
+    outside |= dist >= tol;
+  }
+  return(outside);
+}
+
+/* Rearrange the (dim+1)-by-nf matrix planes so that element k of the
+   plane of facet f is at pt[k*nfp + f], padding the facets to a
+   whole number of chunks with planes that every point is infinitely
+   far inside */
+static double *scanPlanes(const SEXP planes, size_t *pnfp)
+{
+  const double *pl = REAL(planes);
+  int dim = Rf_nrows(planes) - 1, nf = Rf_ncols(planes), k;
+  size_t f, nfp = (nf + INHULLN_SCAN_CHUNK - 1)/INHULLN_SCAN_CHUNK*INHULLN_SCAN_CHUNK;
+  double *pt = (double *) R_alloc((dim + 1)*nfp, sizeof(double));
+  for (f = 0; f < nfp; f++)
+    for (k = 0; k <= dim; k++)
+      pt[k*nfp + f] = f < nf ? pl[(dim + 1)*f + k] : (k == dim ? R_NegInf : 0);
+  *pnfp = nfp;
+  return(pt);
+}
+
+/* Test if the points in rows start to end - 1 of the n-by-dim matrix
+   p are in the hull with nf facets whose planes are arranged in pt as
+   in C_inhulln_scan(), setting the corresponding elements of
+   inside. point must have room for dim doubles. */
+static void inhullnScan(const double *pt, size_t nfp, int nf, double tol,
+                        const double *p, int n, int dim, int start, int end,
+                        double *point, int *inside)
+{
+  int i, k, f;
+  for (i = start; i < end; i++) {
+    for (k = 0; k < dim; k++)
+      point[k] = p[i + (size_t)n*k];
+    int outside = nf == 0;
+    for (f = 0; f < nfp && !outside; f += INHULLN_SCAN_CHUNK) {
+      switch (dim) {
+      case 2:
+        outside = scanChunkOutside(pt + f, nfp, point, 2, tol);
+        break;
+      case 3:
+        outside = scanChunkOutside(pt + f, nfp, point, 3, tol);
+        break;
+      default:
+        outside = scanChunkOutside(pt + f, nfp, point, dim, tol);
+      }
+    }
+    inside[i] = !outside;
+  }
+}
+
+/* Test if the points p are in the hull described by the matrix
+   planes of the normals and offsets of its facets, as produced by
+   C_convhulln_index(). Rather than searching for the facet nearest
+   each point, the distance of each point from every facet is
+   computed until the point is found to be outside. The planes are
+   first rearranged so that each coordinate of the normals of
+   consecutive facets is contiguous, which allows the distances from
+   a chunk of facets to be computed with vector instructions. A point
+   is outside if it is at least tolerance away from a facet, so the
+   results are the same as C_inhulln_index(). The points are divided
+   into blocks, which are tested in nthreads threads. */
+SEXP C_inhulln_scan(const SEXP planes, const SEXP tolerance, const SEXP p, const SEXP nthreads)
+{
+  if(!Rf_isMatrix(p) || !Rf_isReal(p)){
+    Rf_error("Second argument should be a real matrix.");
+  }
+  int dim = Rf_ncols(p), n = Rf_nrows(p), nf = Rf_ncols(planes);
+  if (Rf_nrows(planes) != dim + 1) {
+    Rf_error("Number of columns in test points p (%d) not equal to dimension of hull (%d).", dim, Rf_nrows(planes) - 1);
+  }
+
+  const double *pp = REAL(p);
+  size_t nfp;
+  double *pt = scanPlanes(planes, &nfp);
+
+  SEXP inside = PROTECT(Rf_allocVector(LGLSXP, n));
+  int *in = LOGICAL(inside);
+  double tol = Rf_asReal(tolerance);
+  int nblocks = (n + INHULLN_BLOCK - 1)/INHULLN_BLOCK;
+  int nt = inhullnThreads(Rf_asInteger(nthreads), nblocks);
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(nt)
+#endif
+  {
+    double *point = (double *) malloc((dim + 1)*sizeof(double));
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+#endif
+    for (int b = 0; b < nblocks; b++) {
+      int start = b*INHULLN_BLOCK, end = b == nblocks - 1 ? n : start + INHULLN_BLOCK;
+      if (point)
+        inhullnScan(pt, nfp, nf, tol, pp, n, dim, start, end, point, in);
+      else
+        for (int i = start; i < end; i++)
+          in[i] = NA_LOGICAL;
+    }
+    free(point);
+  }
+  UNPROTECT(1);
+
+  return inside;
+}
+
+/* Compute the distances of the point x from a chunk of facets, whose
+   planes are arranged as in C_inhulln_scan(), in the same way as
+   scanChunkOutside() */
+static inline void scanChunkDist(const double *pt, size_t nfp, const double *x, int dim, double *dist)
+{
+#ifdef _OPENMP
+  #pragma omp simd
+#endif
+  for (int f = 0; f < INHULLN_SCAN_CHUNK; f++) {
+    double d = pt[dim*nfp + f];
+    for (int k = 0; k < dim; k++)
+      d += x[k]*pt[k*nfp + f];
+    dist[f] = d;
+  }
+}
+
+/* Find the greatest signed distance of each of the points in rows
+   start to end - 1 of the n-by-dim matrix p from the facets of the
+   hull whose planes are arranged in pt as in C_inhulln_scan(),
+   setting the corresponding elements of bestdist and of bestfacet,
+   the 1-based index of the first facet at that distance. point must
+   have room for dim doubles. */
+static void inhullnDistance(const double *pt, size_t nfp, int nf,
+                            const double *p, int n, int dim, int start, int end,
+                            double *point, double *bestdist, int *bestfacet)
+{
+  double dist[INHULLN_SCAN_CHUNK];
+  int i, k, f, j;
+  for (i = start; i < end; i++) {
+    for (k = 0; k < dim; k++)
+      point[k] = p[i + (size_t)n*k];
+    double best = R_NegInf;
+    int bestf = NA_INTEGER;
+    for (f = 0; f < nfp; f += INHULLN_SCAN_CHUNK) {
+      switch (dim) {
+      case 2:
+        scanChunkDist(pt + f, nfp, point, 2, dist);
+        break;
+      case 3:
+        scanChunkDist(pt + f, nfp, point, 3, dist);
+        break;
+      default:
+        scanChunkDist(pt + f, nfp, point, dim, dist);
+      }
+      for (j = 0; j < INHULLN_SCAN_CHUNK; j++) {
+        if (dist[j] > best) {
+          best = dist[j];
+          bestf = f + j + 1;
+        }
+      }
+    }
+    bestdist[i] = nf == 0 ? NA_REAL : best;
+    bestfacet[i] = bestf;
+  }
+}
+
+/* Return a list of the points that are inside the hull with nf
+   facets, i.e. less than tol from all of them, and the distances and
+   facets found by inhullnDistance() */
+static SEXP inhullnDistanceList(const SEXP distance, const SEXP facet, double tol, int nf)
+{
+  SEXP inside, retlist, retnames;
+  int n = Rf_length(distance);
+  const double *dist = REAL(distance);
+  inside = PROTECT(Rf_allocVector(LGLSXP, n));
+  for (int i = 0; i < n; i++)
+    LOGICAL(inside)[i] = ISNAN(dist[i]) ? (nf == 0 ? FALSE : NA_LOGICAL) : dist[i] < tol;
+
+  retlist = PROTECT(Rf_allocVector(VECSXP, 3));
+  retnames = PROTECT(Rf_allocVector(STRSXP, 3));
+  SET_VECTOR_ELT(retlist, 0, inside);
+  SET_STRING_ELT(retnames, 0, Rf_mkChar("inside"));
+  SET_VECTOR_ELT(retlist, 1, distance);
+  SET_STRING_ELT(retnames, 1, Rf_mkChar("distance"));
+  SET_VECTOR_ELT(retlist, 2, facet);
+  SET_STRING_ELT(retnames, 2, Rf_mkChar("facet"));
+  Rf_setAttrib(retlist, R_NamesSymbol, retnames);
+  UNPROTECT(3);
+
+  return retlist;
+}
+
+/* Test if the points p are in the hull described by the matrix
+   planes, as in C_inhulln_scan(), and return, for each point, its
+   greatest signed distance from the hyperplanes of the facets and
+   the index of the facet at this distance. Inside the hull, this is
+   minus the distance of the point from the boundary of the hull. All
+   the facets are checked for each point. */
+SEXP C_inhulln_distance(const SEXP planes, const SEXP tolerance, const SEXP p, const SEXP nthreads)
+{
+  if(!Rf_isMatrix(p) || !Rf_isReal(p)){
+    Rf_error("Second argument should be a real matrix.");
+  }
+  int dim = Rf_ncols(p), n = Rf_nrows(p), nf = Rf_ncols(planes);
+  if (Rf_nrows(planes) != dim + 1) {
+    Rf_error("Number of columns in test points p (%d) not equal to dimension of hull (%d).", dim, Rf_nrows(planes) - 1);
+  }
+
+  const double *pp = REAL(p);
+  size_t nfp;
+  double *pt = scanPlanes(planes, &nfp);
+
+  SEXP distance, facet;
+  distance = PROTECT(Rf_allocVector(REALSXP, n));
+  facet = PROTECT(Rf_allocVector(INTSXP, n));
+  double *dist = REAL(distance);
+  int *fac = INTEGER(facet);
+  int nblocks = (n + INHULLN_BLOCK - 1)/INHULLN_BLOCK;
+  int nt = inhullnThreads(Rf_asInteger(nthreads), nblocks);
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(nt)
+#endif
+  {
+    double *point = (double *) malloc((dim + 1)*sizeof(double));
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+#endif
+    for (int b = 0; b < nblocks; b++) {
+      int start = b*INHULLN_BLOCK, end = b == nblocks - 1 ? n : start + INHULLN_BLOCK;
+      if (point)
+        inhullnDistance(pt, nfp, nf, pp, n, dim, start, end, point, dist, fac);
+      else
+        for (int i = start; i < end; i++) {
+          dist[i] = NA_REAL;
+          fac[i] = NA_INTEGER;
+        }
+    }
+    free(point);
+  }
+
+  SEXP retlist = inhullnDistanceList(distance, facet, Rf_asReal(tolerance), nf);
+  UNPROTECT(2);
+
+  return retlist;
+}
+
+/* Maximum number of facets in a leaf of the bounding volume hierarchy
+   built by C_convhulln_bvh() */
+#define INHULLN_BVH_LEAF 16
+
+typedef struct {
+  double key;
+  int f;
+} bvhKeyT;
+
+static int bvhKeyCompare(const void *a, const void *b)
+{
+  const bvhKeyT *ka = a, *kb = b;
+  if (ka->key != kb->key)
+    return(ka->key < kb->key ? -1 : 1);
+  return(ka->f - kb->f);
+}
+
+/* State of C_convhulln_bvh() while building the hierarchy */
+typedef struct {
+  const double *pl;  /* Planes of the facets, as in C_inhulln_index() */
+  const double *c;   /* Centre, relative to which offsets are measured */
+  int dim;
+  int *order;        /* Facets (0-based) in the order of the leaves */
+  int *nodes;        /* first, count and right child of each node */
+  double *bounds;    /* Bounds of each node; see C_convhulln_bvh() */
+  bvhKeyT *keys;
+  int nnodes;
+} bvhBuildT;
+
+/* Add the node containing the count facets from position first in
+   b->order to the hierarchy, splitting it recursively, and return its
+   index. The left child of a node immediately follows it. */
+static int bvhBuild(bvhBuildT *b, int first, int count)
+{
+  int dim = b->dim, i = b->nnodes++, j, k, axis = 0;
+  double *bd = b->bounds + (size_t)(dim + 3)*i;
+  double dmin = R_PosInf, dmax = R_NegInf, rn = 0, spread = -1;
+  const double *pf;
+
+  /* Centre of the normals and range of the offsets relative to c */
+  for (k = 0; k < dim; k++)
+    bd[k] = 0;
+  for (j = first; j < first + count; j++) {
+    pf = b->pl + (size_t)(dim + 1)*b->order[j];
+    double d = pf[dim];
+    for (k = 0; k < dim; k++) {
+      bd[k] += pf[k];
+      d += pf[k]*b->c[k];
+    }
+    if (d < dmin) dmin = d;
+    if (d > dmax) dmax = d;
+  }
+  for (k = 0; k < dim; k++)
+    bd[k] /= count;
+  for (j = first; j < first + count; j++) {
+    pf = b->pl + (size_t)(dim + 1)*b->order[j];
+    double r = 0;
+    for (k = 0; k < dim; k++)
+      r += (pf[k] - bd[k])*(pf[k] - bd[k]);
+    if (r > rn) rn = r;
+  }
+  bd[dim] = (dmin + dmax)/2;
+  bd[dim + 1] = sqrt(rn);
+  bd[dim + 2] = (dmax - dmin)/2;
+
+  b->nodes[3*i] = first;
+  b->nodes[3*i + 1] = count;
+  b->nodes[3*i + 2] = -1;
+  if (count <= INHULLN_BVH_LEAF)
+    return(i);
+
+  /* Split the facets in half along the coordinate of the normals with
+     the greatest spread, so that each child contains facets facing in
+     similar directions */
+  for (k = 0; k < dim; k++) {
+    double lo = R_PosInf, hi = R_NegInf;
+    for (j = first; j < first + count; j++) {
+      double x = b->pl[(size_t)(dim + 1)*b->order[j] + k];
+      if (x < lo) lo = x;
+      if (x > hi) hi = x;
+    }
+    if (hi - lo > spread) {
+      spread = hi - lo;
+      axis = k;
+    }
+  }
+  for (j = 0; j < count; j++) {
+    b->keys[j].f = b->order[first + j];
+    b->keys[j].key = b->pl[(size_t)(dim + 1)*b->keys[j].f + axis];
+  }
+  qsort(b->keys, count, sizeof(bvhKeyT), bvhKeyCompare);
+  for (j = 0; j < count; j++)
+    b->order[first + j] = b->keys[j].f;
+  bvhBuild(b, first, count/2);
+  b->nodes[3*i + 2] = bvhBuild(b, first + count/2, count - count/2);
+  return(i);
+}
+
+/* Build a bounding volume hierarchy over the facets of the hull
+   described by the matrix planes, as in C_inhulln_index(), and a
+   point centre inside the hull. Each node of the tree contains a set
+   of facets, which is split in two to give its children. For a node
+   whose facets have normals n within rn of nc and offsets d, measured
+   relative to centre, within rd of dc, the signed distance of a point
+   x from any of its facets is at most
+
+     nc.(x - centre) + dc + rn|x - centre| + rd
+
+   so a node can be skipped if this bound is less than the tolerance
+   or, when finding the nearest facet, the greatest distance found so
+   far. Returns a list comprising the centre, the facets (1-based) in
+   the order of the leaves, an integer matrix with columns giving
+   the first position in the order (0-based), the number of facets
+   and the right child (0-based, or -1 for a leaf) of each node, and
+   a matrix with columns nc, dc, rn and rd of each node. */
+SEXP C_convhulln_bvh(const SEXP planes, const SEXP centre)
+{
+  int dim = Rf_nrows(planes) - 1, nf = Rf_ncols(planes), j;
+  if (Rf_length(centre) != dim) {
+    Rf_error("Centre of hull should have %d coordinates.", dim);
+  }
+  int nmax = 2*(nf/(INHULLN_BVH_LEAF/2) + 1);
+  bvhBuildT b;
+  b.pl = REAL(planes);
+  b.c = REAL(centre);
+  b.dim = dim;
+  b.order = (int *) R_alloc(nf + 1, sizeof(int));
+  b.nodes = (int *) R_alloc(3*nmax, sizeof(int));
+  b.bounds = (double *) R_alloc((size_t)(dim + 3)*nmax, sizeof(double));
+  b.keys = (bvhKeyT *) R_alloc(nf + 1, sizeof(bvhKeyT));
+  b.nnodes = 0;
+  for (j = 0; j < nf; j++)
+    b.order[j] = j;
+  if (nf > 0)
+    bvhBuild(&b, 0, nf);
+
+  SEXP order, nodes, bounds, retlist, retnames;
+  order = PROTECT(Rf_allocVector(INTSXP, nf));
+  nodes = PROTECT(Rf_allocMatrix(INTSXP, 3, b.nnodes));
+  bounds = PROTECT(Rf_allocMatrix(REALSXP, dim + 3, b.nnodes));
+  for (j = 0; j < nf; j++)
+    INTEGER(order)[j] = b.order[j] + 1;
+  memcpy(INTEGER(nodes), b.nodes, 3*b.nnodes*sizeof(int));
+  memcpy(REAL(bounds), b.bounds, (size_t)(dim + 3)*b.nnodes*sizeof(double));
+
+  retlist = PROTECT(Rf_allocVector(VECSXP, 4));
+  retnames = PROTECT(Rf_allocVector(STRSXP, 4));
+  SET_VECTOR_ELT(retlist, 0, centre);
+  SET_STRING_ELT(retnames, 0, Rf_mkChar("centre"));
+  SET_VECTOR_ELT(retlist, 1, order);
+  SET_STRING_ELT(retnames, 1, Rf_mkChar("order"));
+  SET_VECTOR_ELT(retlist, 2, nodes);
+  SET_STRING_ELT(retnames, 2, Rf_mkChar("nodes"));
+  SET_VECTOR_ELT(retlist, 3, bounds);
+  SET_STRING_ELT(retnames, 3, Rf_mkChar("bounds"));
+  Rf_setAttrib(retlist, R_NamesSymbol, retnames);
+  UNPROTECT(5);
+
+  return retlist;
+}
+
+/* Hierarchy built by C_convhulln_bvh(), as used in queries */
+typedef struct {
+  const double *c;
+  const int *order;
+  const int *nodes;
+  const double *bounds;
+  int nnodes;
+  double slack;      /* Allowance for rounding error in the bounds */
+} bvhT;
+
+/* Upper bound on the signed distance of the point x, whose
+   displacement from the centre is xc, from the facets of node i */
+static inline double bvhBound(const bvhT *h, int i, const double *xc, double xnorm, int dim)
+{
+  const double *bd = h->bounds + (size_t)(dim + 3)*i;
+  double ub = bd[dim] + bd[dim + 1]*xnorm + bd[dim + 2];
+  for (int k = 0; k < dim; k++)
+    ub += bd[k]*xc[k];
+  return(ub);
+}
+
+/* Test if the points in rows start to end - 1 of the n-by-dim matrix
+   p are in the hull with nf facets described by the planes pl and the
+   hierarchy h, setting the corresponding elements of inside. If
+   bestdist is not NULL, also find the greatest signed distance of
+   each point from the facets and the first facet at that distance,
+   as inhullnDistance() does, setting the corresponding elements of
+   bestdist and bestfacet. The tree is searched depth first, visiting
+   the child with the greater bound first, which usually leads
+   straight to the nearest facet. point must have room for 2*dim
+   doubles and stack and stackub for h->nnodes + 1 elements. */
+static void inhullnBvh(const double *pl, int nf, double tol, const bvhT *h,
+                       const double *p, int n, int dim, int start, int end,
+                       double *point, int *stack, double *stackub,
+                       int *inside, double *bestdist, int *bestfacet)
+{
+  double *xc = point + dim;
+  int i, j, k, m, sp;
+  for (i = start; i < end; i++) {
+    double xnorm = 0, xabs = 0;
+    for (k = 0; k < dim; k++) {
+      point[k] = p[i + (size_t)n*k];
+      xc[k] = point[k] - h->c[k];
+      xnorm += xc[k]*xc[k];
+      xabs += fabs(point[k]);
+    }
+    xnorm = sqrt(xnorm);
+    double slack = h->slack*(1 + xabs);
+    double best = R_NegInf;
+    int bestf = NA_INTEGER;
+    sp = 0;
+    if (nf > 0) {
+      stack[sp] = 0;
+      stackub[sp++] = bvhBound(h, 0, xc, xnorm, dim) + slack;
+    }
+    while (sp > 0) {
+      /* Skip nodes that cannot contain a facet that the point is
+         outside of or, if finding the distance, that is further from
+         the point than the best facet found so far */
+      j = stack[--sp];
+      if (stackub[sp] < (bestdist ? best : tol))
+        continue;
+      const int *node = h->nodes + 3*j;
+      if (node[2] < 0) {
+        for (m = node[0]; m < node[0] + node[1]; m++) {
+          int f = h->order[m];
+          double d = planeDist(pl + (size_t)(dim + 1)*(f - 1), point, dim);
+          if (d > best || (d == best && f < bestf)) {
+            best = d;
+            bestf = f;
+          }
+        }
+        if (!bestdist && best >= tol)
+          break;
+      } else {
+        double ubl = bvhBound(h, j + 1, xc, xnorm, dim) + slack;
+        double ubr = bvhBound(h, node[2], xc, xnorm, dim) + slack;
+        if (ubl > ubr) {
+          stack[sp] = node[2];
+          stackub[sp++] = ubr;
+          stack[sp] = j + 1;
+          stackub[sp++] = ubl;
+        } else {
+          stack[sp] = j + 1;
+          stackub[sp++] = ubl;
+          stack[sp] = node[2];
+          stackub[sp++] = ubr;
+        }
+      }
+    }
+    inside[i] = nf > 0 && best < tol;
+    if (bestdist) {
+      bestdist[i] = nf == 0 ? NA_REAL : best;
+      bestfacet[i] = bestf;
+    }
+  }
+}
+
+/* Test if the points p are in the hull described by the matrix
+   planes, as in C_inhulln_scan(), using the hierarchy bvh built by
+   C_convhulln_bvh() to skip groups of facets that no point can be
+   outside of. If distance is TRUE, return the distances and nearest
+   facets as C_inhulln_distance() does. The results are the same as
+   the other methods. */
+SEXP C_inhulln_bvh(const SEXP planes, const SEXP tolerance, const SEXP bvh, const SEXP p,
+                   const SEXP nthreads, const SEXP distance)
+{
+  if(!Rf_isMatrix(p) || !Rf_isReal(p)){
+    Rf_error("Second argument should be a real matrix.");
+  }
+  int dim = Rf_ncols(p), n = Rf_nrows(p), nf = Rf_ncols(planes);
+  if (Rf_nrows(planes) != dim + 1) {
+    Rf_error("Number of columns in test points p (%d) not equal to dimension of hull (%d).", dim, Rf_nrows(planes) - 1);
+  }
+  SEXP nodes = VECTOR_ELT(bvh, 2), bounds = VECTOR_ELT(bvh, 3);
+  if (Rf_length(VECTOR_ELT(bvh, 0)) != dim || Rf_length(VECTOR_ELT(bvh, 1)) != nf ||
+      Rf_nrows(nodes) != 3 || Rf_nrows(bounds) != dim + 3 ||
+      Rf_ncols(bounds) != Rf_ncols(nodes) || (nf > 0 && Rf_ncols(nodes) == 0)) {
+    Rf_error("Hierarchy of facets does not match hull.");
+  }
+
+  bvhT h;
+  h.c = REAL(VECTOR_ELT(bvh, 0));
+  h.order = INTEGER(VECTOR_ELT(bvh, 1));
+  h.nodes = INTEGER(nodes);
+  h.bounds = REAL(bounds);
+  h.nnodes = Rf_ncols(nodes);
+  /* The bounds and distances are computed relative to different
+     origins, so allow for rounding errors proportional to the
+     magnitudes of the centre and the offsets */
+  const double *pl = REAL(planes);
+  double cabs = 0, dabs = 0;
+  int k, f;
+  for (k = 0; k < dim; k++)
+    cabs += fabs(h.c[k]);
+  for (f = 0; f < nf; f++)
+    if (fabs(pl[(size_t)(dim + 1)*f + dim]) > dabs)
+      dabs = fabs(pl[(size_t)(dim + 1)*f + dim]);
+  h.slack = 64*DBL_EPSILON*(dim + 1)*(1 + cabs + dabs);
+
+  int dist = Rf_asLogical(distance) == TRUE;
+  SEXP inside, bestdist = R_NilValue, bestfacet = R_NilValue;
+  inside = PROTECT(Rf_allocVector(LGLSXP, n));
+  if (dist) {
+    bestdist = PROTECT(Rf_allocVector(REALSXP, n));
+    bestfacet = PROTECT(Rf_allocVector(INTSXP, n));
+  }
+  int *in = LOGICAL(inside);
+  double *bd = dist ? REAL(bestdist) : NULL, tol = Rf_asReal(tolerance);
+  int *bf = dist ? INTEGER(bestfacet) : NULL;
+  const double *pp = REAL(p);
+  int nblocks = (n + INHULLN_BLOCK - 1)/INHULLN_BLOCK;
+  int nt = inhullnThreads(Rf_asInteger(nthreads), nblocks);
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(nt)
+#endif
+  {
+    double *point = (double *) malloc((2*dim + 1)*sizeof(double));
+    int *stack = (int *) malloc((h.nnodes + 1)*sizeof(int));
+    double *stackub = (double *) malloc((h.nnodes + 1)*sizeof(double));
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic)
+#endif
+    for (int b = 0; b < nblocks; b++) {
+      int start = b*INHULLN_BLOCK, end = b == nblocks - 1 ? n : start + INHULLN_BLOCK;
+      if (point && stack && stackub)
+        inhullnBvh(pl, nf, tol, &h, pp, n, dim, start, end, point, stack, stackub, in, bd, bf);
+      else
+        for (int i = start; i < end; i++) {
+          in[i] = NA_LOGICAL;
+          if (dist) {
+            bd[i] = NA_REAL;
+            bf[i] = NA_INTEGER;
+          }
+        }
+    }
+    free(point);
+    free(stack);
+    free(stackub);
+  }
+
+  if (dist) {
+    SEXP retlist = inhullnDistanceList(bestdist, bestfacet, tol, nf);
+    UNPROTECT(3);
+    return retlist;
+  }
+  UNPROTECT(1);
+
+  return inside;
+}
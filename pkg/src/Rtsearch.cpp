@@ -16,15 +16,30 @@
 //  3  may 2017: copy from package lidR to package geometry by Jean-Romain Roussel to replace former code of tsearch
 //  4  may 2017: Add barycentric coordinates support to reproduce original tsearch function
 // 23 sept 2017: fix bug of computeur precision by Jean-Romain Roussel
+// 18 oct  2026: add persistent TriLocator for repeated queries against one triangulation
+//               and walking point location
+// 18 oct  2026: multithreaded tsearch
+// 18 oct  2026: index xi and yi in place rather than copying them
+// 18 oct  2026: batched point in triangle tests
+// 18 oct  2026: write the results of tsearch.locate to files
+// 18 oct  2026: compiled tsearchn using SimplexLocator
 
 
 // [[Rcpp::depends(RcppProgress)]]
 #include <progress.hpp>
 #include <Rcpp.h>
 #include "QuadTree.h"
+#include "TriLocator.h"
+#include "SimplexLocator.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace Rcpp;
 
+// Number of points located at a time when writing to files
+#define TSEARCH_FILE_BLOCK 65536
+
 static inline double max (double a, double b, double c)
 {
   if (a < b)
@@ -41,41 +56,92 @@ static inline double min (double a, double b, double c)
     return (a > c ? c : a);
 }
 
-bool PointInTriangle(Point p0, Point p1, Point p2, Point p, Point* bary, double eps)
-{
-  double det = ((p1.y - p2.y)*(p0.x - p2.x) + (p2.x - p1.x)*(p0.y - p2.y));
-  double a = ((p1.y - p2.y)*(p.x - p2.x) + (p2.x - p1.x)*(p.y - p2.y)) / det;
-  double b = ((p2.y - p0.y)*(p.x - p2.x) + (p0.x - p2.x)*(p.y - p2.y)) / det;
-  double c = 1 - a - b;
-
-  bary->x = c;
-  bary->y = b;
-
-  return -eps <= a && a <= 1+eps && -eps <= b && b <= 1+eps && -eps <= c && c <= 1+eps;
-}
-
 //' @importFrom Rcpp sourceCpp
 // [[Rcpp::export]]
-SEXP C_tsearch(NumericVector x,  NumericVector y, IntegerMatrix elem, NumericVector xi, NumericVector yi, bool bary = false, double eps = 1.0e-12)
+SEXP C_tsearch(NumericVector x,  NumericVector y, IntegerMatrix elem, NumericVector xi, NumericVector yi, bool bary = false, double eps = 1.0e-12, int nthreads = 1, int leaf_size = 32, int max_depth = 32)
 {
-  std::vector<double> xx = as< std::vector<double> >(xi);
-  std::vector<double> yy = as< std::vector<double> >(yi);
+  int nelem = elem.nrow();
+  int np = xi.size();
 
-  // Compute the minimum of each vector
-  double xoffset = *std::min_element(xx.begin(), xx.end());
-  double yoffset = *std::min_element(yy.begin(), yy.end());
+  // A point that is not finite cannot be inserted into the QuadTree,
+  // and would break the ordering used to split the points into strips
+  for (int i = 0 ; i < np ; i++)
+    if (!std::isfinite(xi[i]) || !std::isfinite(yi[i]))
+      Rcpp::stop("Query points xi and yi must be finite");
+
+  // The QuadTree indexes xi and yi in place. The coordinates are taken
+  // relative to their minimum, which is subtracted when points are
+  // compared (see Issue #57)
+  const double *pxi = xi.begin();
+  const double *pyi = yi.begin();
+  double xoffset = *std::min_element(pxi, pxi + np);
+  double yoffset = *std::min_element(pyi, pyi + np);
+
+#ifdef _OPENMP
+  nthreads = std::max(1, std::min(nthreads, np));
+#else
+  nthreads = 1;
+#endif
+
+  // With several threads, the query points are split into vertical
+  // strips holding equal numbers of points, each with its own
+  // QuadTree. Each thread loops over all the triangles in order but
+  // only writes the results of the points in its own strip, so the
+  // writes do not race and, as in the serial case, a point on an edge
+  // is assigned to the triangle with the higher index.
+  std::vector<QuadTree*> trees(nthreads, nullptr);
+  std::vector<BoundingBox> strip_bb(nthreads);
+
+  if (nthreads == 1)
+  {
+    trees[0] = QuadTree::create(pxi, pyi, np, NULL, xoffset, yoffset, eps, leaf_size, max_depth);
+  }
+  else
+  {
+    std::vector<int> order(np);
+    for (int i = 0 ; i < np ; i++)
+      order[i] = i;
+
+    for (int t = 1 ; t < nthreads ; t++)
+    {
+      std::nth_element(order.begin() + (long long)np*(t - 1)/nthreads,
+                       order.begin() + (long long)np*t/nthreads,
+                       order.end(),
+                       [pxi](int i, int j) { return pxi[i] < pxi[j]; });
+    }
 
-  // Subtract the minimum from all elements in the vector
-  std::transform(xx.begin(), xx.end(), xx.begin(), [xoffset](double& elem) { return elem - xoffset; });
-  std::transform(yy.begin(), yy.end(), yy.begin(), [yoffset](double& elem) { return elem - yoffset; });
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(nthreads)
+#endif
+    for (int t = 0 ; t < nthreads ; t++)
+    {
+      int start = (long long)np*t/nthreads;
+      int end = (long long)np*(t + 1)/nthreads;
+
+      double minx = pxi[order[start]] - xoffset;
+      double maxx = minx;
+      double miny = pyi[order[start]] - yoffset;
+      double maxy = miny;
+      for (int i = start ; i < end ; i++)
+      {
+        minx = std::min(minx, pxi[order[i]] - xoffset);
+        maxx = std::max(maxx, pxi[order[i]] - xoffset);
+        miny = std::min(miny, pyi[order[i]] - yoffset);
+        maxy = std::max(maxy, pyi[order[i]] - yoffset);
+      }
+      strip_bb[t] = BoundingBox(Point((minx + maxx)/2, (miny + maxy)/2),
+                                Point((maxx - minx)/2 + eps, (maxy - miny)/2 + eps));
 
-  QuadTree *tree = QuadTree::create(xx, yy, eps);
+      trees[t] = QuadTree::create(pxi, pyi, end - start, &order[start], xoffset, yoffset, eps, leaf_size, max_depth);
+    }
+  }
 
-  if (tree == nullptr)
+  if (std::find(trees.begin(), trees.end(), nullptr) != trees.end())
+  {
+    for (int t = 0 ; t < nthreads ; t++)
+      delete trees[t];
     Rcpp::stop("Failed to insert point into QuadTree.\nPlease post input to tsearch  (or tsearchn at\nhttps://github.com/davidcsterratt/geometry/issues\nor email the maintainer.");
-
-  int nelem = elem.nrow();
-  int np = xi.size();
+  }
 
   // set false -> true if you want to display a progressbar
   Progress p(nelem, false);
@@ -91,66 +157,120 @@ SEXP C_tsearch(NumericVector x,  NumericVector y, IntegerMatrix elem, NumericVec
     std::fill(barycentric.begin(), barycentric.end(), NA_REAL);
   }
 
-  // Loop over each triangle
-  for (int k = 0; k < nelem; k++)
+  // Raw pointers, as Rcpp objects must not be touched from other
+  // threads
+  const double *px = x.begin();
+  const double *py = y.begin();
+  const int *pelem = elem.begin();
+  int *pindexes = indexes.begin();
+  double *pbarycentric = bary ? barycentric.begin() : NULL;
+  bool aborted = false;
+
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(nthreads)
+#endif
   {
-    if (Progress::check_abort() )
+    int t = 0;
+#ifdef _OPENMP
+    t = omp_get_thread_num();
+#endif
+    QuadTree *tree = trees[t];
+    std::vector<int> points;
+    double bx[TRIANGLE_MAP_BLOCK], by[TRIANGLE_MAP_BLOCK];
+    double ba[TRIANGLE_MAP_BLOCK], bb[TRIANGLE_MAP_BLOCK];
+
+    // Loop over each triangle
+    for (int k = 0; k < nelem; k++)
     {
-      delete tree;
-      return indexes;
-    }
-    else
-      p.update(k);
+      if (Progress::check_abort() )
+      {
+#ifdef _OPENMP
+        #pragma omp atomic write
+#endif
+        aborted = true;
+        break;
+      }
+      else if (t == 0)
+        p.update(k);
 
-    // Retrieve triangle A B C coordinates
+      // Retrieve triangle A B C coordinates
 
-    int iA = elem(k, 0) - 1;
-    int iB = elem(k, 1) - 1;
-    int iC = elem(k, 2) - 1;
+      int iA = pelem[k] - 1;
+      int iB = pelem[k + nelem] - 1;
+      int iC = pelem[k + 2*nelem] - 1;
 
-    Point A(x(iA)-xoffset, y(iA)-yoffset);
-    Point B(x(iB)-xoffset, y(iB)-yoffset);
-    Point C(x(iC)-xoffset, y(iC)-yoffset);
+      Point A(px[iA]-xoffset, py[iA]-yoffset);
+      Point B(px[iB]-xoffset, py[iB]-yoffset);
+      Point C(px[iC]-xoffset, py[iC]-yoffset);
 
-    // Boundingbox of A B C
+      // Boundingbox of A B C
 
-    double rminx = min(A.x, B.x, C.x);
-    double rmaxx = max(A.x, B.x, C.x);
-    double rminy = min(A.y, B.y, C.y);
-    double rmaxy = max(A.y, B.y, C.y);
+      double rminx = min(A.x, B.x, C.x);
+      double rmaxx = max(A.x, B.x, C.x);
+      double rminy = min(A.y, B.y, C.y);
+      double rmaxy = max(A.y, B.y, C.y);
 
-    double xcenter =     (rminx + rmaxx)/2;
-    double ycenter =     (rminy + rmaxy)/2;
-    double half_width =  (rmaxx - rminx)/2;
-    double half_height = (rmaxy - rminy)/2;
+      double xcenter =     (rminx + rmaxx)/2;
+      double ycenter =     (rminy + rmaxy)/2;
+      double half_width =  (rmaxx - rminx)/2;
+      double half_height = (rmaxy - rminy)/2;
 
-    // QuadTree search of points in enclosing boundingbox
+      BoundingBox box(Point(xcenter, ycenter), Point(half_width + eps, half_height + eps));
 
-    std::vector<Point*> points;
-    tree->rect_lookup(xcenter, ycenter, half_width + eps, half_height + eps, points);
+      if (nthreads > 1 && !strip_bb[t].intersects(box))
+        continue;
 
-    // Compute if the points are in A B C
+      // QuadTree search of points in enclosing boundingbox
 
-    for (unsigned int i = 0 ; i < points.size() ; i++)
-    {
-      Point pbary;
+      points.clear();
+      tree->rect_lookup(xcenter, ycenter, half_width + eps, half_height + eps, points);
+
+      // Compute if the points are in A B C, mapping them to
+      // barycentric coordinates in blocks
 
-      if (PointInTriangle(A, B, C, *points[i], &pbary, eps))
+      TriangleMap T(A, B, C);
+      int npoints = points.size();
+
+      for (int start = 0 ; start < npoints ; start += TRIANGLE_MAP_BLOCK)
       {
-        int id = points[i]->id;
-        indexes(id) = k + 1;
+        int n = std::min(TRIANGLE_MAP_BLOCK, npoints - start);
 
-        if(bary)
+        for (int i = 0 ; i < n ; i++)
         {
-          barycentric(id, 0) = 1 - pbary.x - pbary.y;
-          barycentric(id, 1) = pbary.y;
-          barycentric(id, 2) = pbary.x;
+          bx[i] = pxi[points[start + i]] - xoffset;
+          by[i] = pyi[points[start + i]] - yoffset;
+        }
+
+        T.map(bx, by, n, ba, bb);
+
+        for (int i = 0 ; i < n ; i++)
+        {
+          double a = ba[i];
+          double b = bb[i];
+          double c = 1 - a - b;
+
+          if (-eps <= a && a <= 1+eps && -eps <= b && b <= 1+eps && -eps <= c && c <= 1+eps)
+          {
+            int id = points[start + i];
+            pindexes[id] = k + 1;
+
+            if(bary)
+            {
+              pbarycentric[id] = 1 - c - b;
+              pbarycentric[id + np] = b;
+              pbarycentric[id + 2*np] = c;
+            }
+          }
         }
       }
     }
   }
 
-  delete tree;
+  for (int t = 0 ; t < nthreads ; t++)
+    delete trees[t];
+
+  if (aborted)
+    return indexes;
 
   if (bary)
   {
@@ -159,3 +279,249 @@ SEXP C_tsearch(NumericVector x,  NumericVector y, IntegerMatrix elem, NumericVec
   else
     return (indexes);
 }
+
+static TriLocator* get_locator(List locator)
+{
+  SEXP ptr = Rf_getAttrib(locator, Rf_install("tsearch.locator"));
+
+  if (TYPEOF(ptr) != EXTPTRSXP)
+    Rcpp::stop("Locator has no tsearch.locator attribute");
+
+  XPtr<TriLocator> loc(ptr);
+
+  if (loc.get() == NULL)
+  {
+    // External pointers do not survive serialisation, e.g. by
+    // saveRDS(), so rebuild the index from the stored triangulation
+    NumericVector x = locator["x"];
+    NumericVector y = locator["y"];
+    IntegerMatrix elem = locator["t"];
+    R_SetExternalPtrAddr(ptr, new TriLocator(x.begin(), y.begin(), x.size(), elem.begin(), elem.nrow(), 1.0e-12));
+    loc.setDeleteFinalizer();
+  }
+
+  return loc.get();
+}
+
+// [[Rcpp::export]]
+SEXP C_tsearch_locator(NumericVector x, NumericVector y, IntegerMatrix elem, double eps = 1.0e-12)
+{
+  XPtr<TriLocator> loc(new TriLocator(x.begin(), y.begin(), x.size(), elem.begin(), elem.nrow(), eps), true);
+  return loc;
+}
+
+// Locate the np points (pxi[i], pyi[i]), writing the 1-based triangle
+// indices to idx[i] and, if bary is not null, the barycentric
+// coordinates to bary[i*stride_i + j*stride_j]. Returns false if the
+// user interrupted.
+static bool locate_points(const TriLocator *loc, const double *pxi, const double *pyi, const int np, const bool walk, int nthreads, int *idx, double *bary, const int stride_i, const int stride_j)
+{
+#ifdef _OPENMP
+  nthreads = std::max(1, std::min(nthreads, np));
+#else
+  nthreads = 1;
+#endif
+
+  // set false -> true if you want to display a progressbar
+  Progress p(np, false);
+
+  bool aborted = false;
+
+  // Each thread locates a contiguous block of the points, so that
+  // walks start from the previous point in the same block
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(nthreads)
+#endif
+  {
+    int t = 0;
+#ifdef _OPENMP
+    t = omp_get_thread_num();
+#endif
+    int start = (long long)np*t/nthreads;
+    int end = (long long)np*(t + 1)/nthreads;
+    double pbary[3];
+    int k = -1;
+
+    for (int i = start; i < end; i++)
+    {
+      if ((i - start) % 1024 == 0)
+      {
+        if (Progress::check_abort())
+        {
+#ifdef _OPENMP
+          #pragma omp atomic write
+#endif
+          aborted = true;
+          break;
+        }
+        else if (t == 0)
+          p.update(i);
+      }
+
+      // When walking, start from the triangle containing the previous
+      // point
+      if (walk)
+        k = loc->walk(pxi[i], pyi[i], k, bary ? pbary : NULL);
+      else
+        k = loc->locate(pxi[i], pyi[i], bary ? pbary : NULL);
+
+      idx[i] = k < 0 ? NA_INTEGER : k + 1;
+
+      if(bary)
+      {
+        for (int j = 0; j < 3; j++)
+          bary[(long long)i*stride_i + (long long)j*stride_j] = k < 0 ? NA_REAL : pbary[j];
+      }
+    }
+  }
+
+  return !aborted;
+}
+
+// [[Rcpp::export]]
+SEXP C_tsearch_locate(List locator, NumericVector xi, NumericVector yi, bool bary = false, bool walk = false, int nthreads = 1)
+{
+  TriLocator *loc = get_locator(locator);
+
+  int np = xi.size();
+
+  IntegerVector indexes(np);
+  NumericMatrix barycentric;
+
+  if(bary)
+    barycentric = NumericMatrix(np, 3);
+
+  if (!locate_points(loc, xi.begin(), yi.begin(), np, walk, nthreads,
+                     indexes.begin(), bary ? barycentric.begin() : NULL, 1, np))
+    Rcpp::stop("Interrupted");
+
+  if (bary)
+  {
+    return (List::create(indexes, barycentric));
+  }
+  else
+    return (indexes);
+}
+
+// Append the triangle indices of the points (xi, yi) to idx_file as
+// 4-byte integers and, if bary_file is not empty, their barycentric
+// coordinates to bary_file as 3 doubles per point. The points are
+// located in blocks of TSEARCH_FILE_BLOCK, so that the memory used
+// does not depend on the number of points.
+// [[Rcpp::export]]
+int C_tsearch_locate_file(List locator, NumericVector xi, NumericVector yi, std::string idx_file, std::string bary_file, bool walk = false, int nthreads = 1)
+{
+  TriLocator *loc = get_locator(locator);
+
+  int np = xi.size();
+  bool bary = !bary_file.empty();
+
+  FILE *fidx = fopen(R_ExpandFileName(idx_file.c_str()), "ab");
+  if (fidx == NULL)
+    Rcpp::stop("Unable to open file " + idx_file + " for writing");
+
+  FILE *fbary = NULL;
+  if (bary)
+  {
+    fbary = fopen(R_ExpandFileName(bary_file.c_str()), "ab");
+    if (fbary == NULL)
+    {
+      fclose(fidx);
+      Rcpp::stop("Unable to open file " + bary_file + " for writing");
+    }
+  }
+
+  std::vector<int> idx(std::min(np, TSEARCH_FILE_BLOCK));
+  std::vector<double> pbary(bary ? 3*idx.size() : 0);
+  bool ok = true, aborted = false;
+
+  for (int start = 0 ; start < np && ok ; start += TSEARCH_FILE_BLOCK)
+  {
+    int n = std::min(TSEARCH_FILE_BLOCK, np - start);
+
+    if (!locate_points(loc, xi.begin() + start, yi.begin() + start, n, walk, nthreads,
+                       idx.data(), bary ? pbary.data() : NULL, 3, 1))
+    {
+      aborted = true;
+      break;
+    }
+
+    ok = fwrite(idx.data(), sizeof(int), n, fidx) == (size_t)n;
+    if (ok && bary)
+      ok = fwrite(pbary.data(), sizeof(double), 3*n, fbary) == (size_t)3*n;
+  }
+
+  fclose(fidx);
+  if (fbary)
+    fclose(fbary);
+
+  // The files hold only the blocks written before the interrupt, so
+  // do not report that all the points were written
+  if (aborted)
+    Rcpp::stop("Interrupted");
+
+  if (!ok)
+    Rcpp::stop("Error writing to file");
+
+  return np;
+}
+
+// Locate the points xi (an m-by-n matrix) in the simplices t (a
+// matrix of 1-based indices into the rows of the n-column matrix x),
+// as tsearchn() does. Returns the simplex indices, the barycentric
+// coordinates and the indices of the degenerate simplices that the
+// original loop over the simplices in R would have reported.
+// [[Rcpp::export]]
+List C_tsearchn_simplex(NumericMatrix x, IntegerMatrix t, NumericMatrix xi)
+{
+  int dim = x.ncol();
+  int nt = t.nrow();
+  int mi = xi.nrow();
+
+  SimplexLocator loc(x.begin(), x.nrow(), dim, t.begin(), nt, 1e-12);
+
+  IntegerVector idx(mi, NA_INTEGER);
+  NumericMatrix p(mi, dim + 1);
+  std::fill(p.begin(), p.end(), NA_REAL);
+
+  std::vector<double> bary(dim + 1), work(dim + 1);
+  int last = 0;
+  bool found_all = true;
+
+  std::vector<int> perm;
+  loc.spatial_order(xi.begin(), mi, perm);
+
+  Progress progress(mi, false);
+
+  for (int n = 0 ; n < mi ; n++)
+  {
+    if (n % 1024 == 0 && Progress::check_abort())
+      Rcpp::stop("Interrupted");
+
+    int i = perm[n];
+    int k = loc.locate(&xi(i, 0), mi, bary.data(), work.data());
+
+    if (k < 0)
+    {
+      found_all = false;
+      continue;
+    }
+
+    idx[i] = k + 1;
+    for (int j = 0 ; j <= dim ; j++)
+      p(i, j) = bary[j];
+    last = std::max(last, k + 1);
+  }
+
+  // The loop in R stopped at the simplex in which the last point was
+  // found, so only reported degenerate simplices before it
+  if (found_all)
+    nt = std::min(nt, last);
+
+  std::vector<int> degenerate;
+  for (int k = 0 ; k < nt ; k++)
+    if (loc.is_degenerate(k))
+      degenerate.push_back(k + 1);
+
+  return List::create(Named("idx") = idx, Named("p") = p, Named("degenerate") = wrap(degenerate));
+}
@@ -22,12 +22,103 @@
 #include <Rdefines.h>
 #include <R_ext/Rdynload.h>
 #include <Rinternals.h>
+#include <float.h>
+#include <string.h>
 #include "Rgeometry.h"
 #include "qhull_ra.h"
 
+/* Tolerance on barycentric coordinates, as in tsearchn() */
+#define TSEARCHN_EPS 1e-12
+
+/* Compute the barycentric coordinates b[0], ..., b[N] of the point x
+   with respect to the simplex whose vertices are the first N
+   coordinates of the points v[0], ..., v[N], as cart2bary() does.
+   With X1 the matrix whose rows are v[i] - v[N], the first N
+   coordinates solve t(X1) %*% b = x - v[N]; this is done by Gaussian
+   elimination with partial pivoting in the work space A, which must
+   have room for N*N doubles. Returns 0 if the simplex is
+   degenerate. */
+static int simplex_bary(const int N, pointT **v, const coordT *x, double *A, double *b)
+{
+  int r, c, k, piv;
+  double anorm = 0, s, tmp;
+
+  for (r = 0; r < N; r++) {
+    for (c = 0; c < N; c++) {
+      A[r + N*c] = v[c][r] - v[N][r];
+      if (fabs(A[r + N*c]) > anorm)
+        anorm = fabs(A[r + N*c]);
+    }
+    b[r] = x[r] - v[N][r];
+  }
+
+  for (k = 0; k < N; k++) {
+    piv = k;
+    for (r = k + 1; r < N; r++)
+      if (fabs(A[r + N*k]) > fabs(A[piv + N*k]))
+        piv = r;
+    if (!(fabs(A[piv + N*k]) > N*DBL_EPSILON*anorm))
+      return 0;
+    if (piv != k) {
+      for (c = k; c < N; c++) {
+        tmp = A[k + N*c]; A[k + N*c] = A[piv + N*c]; A[piv + N*c] = tmp;
+      }
+      tmp = b[k]; b[k] = b[piv]; b[piv] = tmp;
+    }
+    for (r = k + 1; r < N; r++) {
+      s = A[r + N*k]/A[k + N*k];
+      for (c = k + 1; c < N; c++)
+        A[r + N*c] -= s*A[k + N*c];
+      b[r] -= s*b[k];
+    }
+  }
+
+  s = 0;
+  for (k = N - 1; k >= 0; k--) {
+    for (c = k + 1; c < N; c++)
+      b[k] -= A[k + N*c]*b[c];
+    b[k] /= A[k + N*k];
+    s += b[k];
+  }
+  b[N] = 1 - s;
+
+  return 1;
+}
+
+/* Barycentric coordinates of x with respect to facet, in the order
+   of facet->vertices, which is also the order of the columns of the
+   triangulation returned by delaunayn(). vv and v must have room for
+   N + 1 pointers. */
+static int facet_bary(qhT *qh, facetT *facet, const int N, const coordT *x, vertexT **vv, pointT **v, double *A, double *b)
+{
+  vertexT *vertex, **vertexp;
+  int j = 0;
+  FOREACHvertex_ (facet->vertices) {
+    if (j > N)
+      return 0;
+    vv[j] = vertex;
+    v[j] = vertex->point;
+    j++;
+  }
+  if (j != N + 1)
+    return 0;
+  return simplex_bary(N, v, x, A, b);
+}
+
+/* The neighbour of a simplicial facet across the ridge opposite
+   vertex, or NULL if there is none */
+static facetT *facet_opposite(qhT *qh, facetT *facet, vertexT *vertex)
+{
+  facetT *neighbor, **neighborp;
+  FOREACHneighbor_(facet) {
+    if (!qh_setin(neighbor->vertices, vertex))
+      return neighbor;
+  }
+  return NULL;
+}
+
 SEXP C_tsearchn(const SEXP dt, const SEXP p)
 {
-  int debug = 0;
   /* Get the qh object from the delaunayn object */
   SEXP ptr, tag;
   qhT *qh;
@@ -39,6 +130,11 @@ SEXP C_tsearchn(const SEXP dt, const SEXP p)
   }
   qh = R_ExternalPtrAddr(ptr);
   UNPROTECT(2);
+  /* The triangulation is not restored if the object has been saved
+     and loaded */
+  if (qh == NULL) {
+    Rf_error("Qhull structure of Delaunay triangulation is no longer available");
+  }
 
   /* Check input matrix */
   if(!Rf_isMatrix(p) || !Rf_isReal(p)){
@@ -52,116 +148,132 @@ SEXP C_tsearchn(const SEXP dt, const SEXP p)
   }
   if (dim != qh->hull_dim)
     Rf_error("Invalid input matrix.");
-  
-  /* Construct map from facet id to index */ 
-  facetT *facet;
+  const int N = dim - 1;        /* Dimension of the triangulation */
 
-  /* Count the number of facets so we know how much space to
-     allocate in R */
+  /* Construct map from facet id to index in the triangulation
+     returned by delaunayn(), which omits upper Delaunay facets and
+     facets of zero area. Facets not in the triangulation map to 0. */
+  facetT *facet;
   int nf = 0;                   /* Number of facets */
-  int max_facet_id = 0;
-  int exitcode = 0;
+  int *idmap = (int *) R_alloc(qh->facet_id + 1, sizeof(int));
+  memset(idmap, 0, (qh->facet_id + 1)*sizeof(int));
   FORALLfacets {
+    /* Double check. Non-simplicial facets will cause segfault
+       below */
+    if (!facet->simplicial) {
+      Rf_error("Qhull returned non-simplicial facets -- try delaunayn with different options");
+    }
     if (!facet->upperdelaunay) {
-      nf++;
-      if (facet->id > max_facet_id)
-        max_facet_id = facet->id;
-
-      /* Double check. Non-simplicial facets will cause segfault
-         below */
-      if (!facet->simplicial) {
-        Rprintf("Qhull returned non-simplicial facets -- try delaunayn with different options");
-        exitcode = 1;
-        break;
+      if (!facet->isarea) {
+        facet->f.area= qh_facetarea(qh, facet);
+        facet->isarea= True;
       }
+      if (facet->f.area)
+        idmap[facet->id] = ++nf;
     }
   }
 
-  int *idmap = (int *) R_alloc(max_facet_id + 1, sizeof(int));
-  int i = 0;
-  FORALLfacets {
-    if (!facet->upperdelaunay) {
-      i++;
-      if (debug & 1) Rprintf("Facet id %d; index %d\n;", facet->id, i);
-       if (facet->id < 1 || facet->id > max_facet_id) {
-         Rf_error("facet_id %d (at index %d) is not in {1,...,%d}", facet->id, i, max_facet_id);
-       }
-      idmap[facet->id] = i;
-    }
-  }
-    
   /* Make space for output */
   SEXP retlist, retnames;       /* Return list and names */
-  int retlen = 2;               /* Length of return list */
-  SEXP idx, points;
+  SEXP idx, bary;
   idx = PROTECT(Rf_allocVector(INTSXP, n));
+  bary = PROTECT(Rf_allocMatrix(REALSXP, n, N + 1));
   int *iidx = INTEGER(idx);
-  points = PROTECT(Rf_allocMatrix(REALSXP, qh->num_points, dim - 1));
-
-  int j, k;
-
-  /* Output points */
-  pointT *point;
-  pointT *pointtemp;
-  if (debug & 2) Rprintf("%d POINTS\n", qh->num_points);
-  i = 0;
-  FORALLpoints {
-    for (k=0; k<(dim - 1); k++) {
-      REAL(points)[i+k*qh->num_points] = point[k];
-      if (debug & 2) Rprintf("%f ", point[k]);
-    }
-    i++;
-    if (debug & 2) Rprintf("\n");
-  }
-  
-  /* Run through the matrix using qh_findbestfacet to determine
-     whether in hull or not */
+  double *pbary = REAL(bary);
+
+  /* Work space */
+  coordT *testpoint = (coordT *) R_alloc(dim, sizeof(coordT));
+  vertexT **vv = (vertexT **) R_alloc(N + 1, sizeof(vertexT *));
+  pointT **v = (pointT **) R_alloc(N + 1, sizeof(pointT *));
+  double *A = (double *) R_alloc(N*N, sizeof(double));
+  double *b = (double *) R_alloc(N + 1, sizeof(double));
+
   boolT isoutside;
   realT bestdist;
-  vertexT *vertex, **vertexp;
+  facetT *found, *next, *neighbor, **neighborp;
+  int i, j, k, jmin, steps, search;
 
-  /* The name point is reserved for use with FORALLpoints */
-  coordT *testpoint;
-  testpoint = (coordT *) R_alloc(dim, sizeof(coordT));
+  for (i = 0; i < n; i++) {
+    if (i % 1024 == 0)
+      R_CheckUserInterrupt();
 
-  for(i=0; i < n; i++) {
-    if (debug) Rprintf("\nTestpoint\n");
-    for(k=0; k < (dim - 1); k++) {
-      testpoint[k] = REAL(p)[i+n*k]; /* could have been pt_array = REAL(p) if p had been transposed */
-      if (debug) Rprintf(" %f", testpoint[k]);
-    }
-    if (debug) Rprintf("\n");
+    /* Lift the point onto the paraboloid and find the best facet */
+    for (k = 0; k < N; k++)
+      testpoint[k] = REAL(p)[i + n*k];
     qh_setdelaunay(qh, dim, 1, testpoint);
     facet = qh_findbestfacet(qh, testpoint, qh_ALL, &bestdist, &isoutside);
-    if (facet->tricoplanar) {
-      exitcode = 1;
-      break;
+
+    /* The best facet is not always the facet containing the point,
+       particularly in 4D and above, so walk from it towards the point
+       across the ridge opposite the vertex with the most negative
+       barycentric coordinate. As the triangulation is convex, the
+       point is outside it if the walk leaves it. If the walk meets a
+       degenerate facet or does not finish, search all the facets. */
+    found = NULL;
+    search = 0;
+    if (facet->upperdelaunay) {
+      next = NULL;
+      FOREACHneighbor_(facet) {
+        if (!neighbor->upperdelaunay) {
+          next = neighbor;
+          break;
+        }
+      }
+      facet = next;
+      if (!facet)
+        search = 1;
     }
-    if (debug) Rprintf("Facet id %d; index %d\n", facet->id, idmap[facet->id]);
-    /* Convert facet id to id of triangle */
-    iidx[i] = idmap[facet->id];
-    /* /\* Return vertices of triangle *\/ */
-    j = 0;
-    FOREACHvertex_ (facet->vertices) {
-      for (j=0; j<dim - 1; j++) {
-        if (debug) Rprintf("%f ", vertex->point[j]);
+    for (steps = 0; !search && !found; steps++) {
+      if (steps == nf || !idmap[facet->id] ||
+          !facet_bary(qh, facet, N, testpoint, vv, v, A, b)) {
+        search = 1;
+        break;
+      }
+      jmin = 0;
+      for (j = 1; j <= N; j++)
+        if (b[j] < b[jmin])
+          jmin = j;
+      if (b[jmin] >= -TSEARCHN_EPS) {
+        found = facet;
+        break;
+      }
+      facet = facet_opposite(qh, facet, vv[jmin]);
+      if (!facet || facet->upperdelaunay)
+        break;
+    }
+    if (search) {
+      FORALLfacets {
+        if (idmap[facet->id] &&
+            facet_bary(qh, facet, N, testpoint, vv, v, A, b)) {
+          for (j = 0; j <= N && b[j] >= -TSEARCHN_EPS; j++);
+          if (j > N) {
+            found = facet;
+            break;
+          }
+        }
       }
-      if (debug) Rprintf("\n");
     }
 
+    /* Convert facet id to id of triangle */
+    if (found) {
+      iidx[i] = idmap[found->id];
+      for (j = 0; j <= N; j++)
+        pbary[i + n*j] = b[j];
+    } else {
+      iidx[i] = NA_INTEGER;
+      for (j = 0; j <= N; j++)
+        pbary[i + n*j] = NA_REAL;
+    }
   }
 
-  retlist = PROTECT(Rf_allocVector(VECSXP, retlen));
-  retnames = PROTECT(Rf_allocVector(VECSXP, retlen));
+  retlist = PROTECT(Rf_allocVector(VECSXP, 2));
+  retnames = PROTECT(Rf_allocVector(STRSXP, 2));
   SET_VECTOR_ELT(retlist, 0, idx);
-  SET_VECTOR_ELT(retnames, 0, Rf_mkChar("idx"));
-  SET_VECTOR_ELT(retlist, 1, points);
-  SET_VECTOR_ELT(retnames, 1, Rf_mkChar("P"));
+  SET_STRING_ELT(retnames, 0, Rf_mkChar("idx"));
+  SET_VECTOR_ELT(retlist, 1, bary);
+  SET_STRING_ELT(retnames, 1, Rf_mkChar("p"));
   Rf_setAttrib(retlist, R_NamesSymbol, retnames);
   UNPROTECT(4);
-  
-  if (exitcode)
-    Rf_error("findDelaunay: not implemented for triangulated, non-simplicial Delaunay regions (tricoplanar facet, f%d).", facet->id);
-  
+
   return retlist;
 }
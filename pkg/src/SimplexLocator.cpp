@@ -0,0 +1,331 @@
+/*
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; either version 3 of the License, or (at your
+  option) any later version.
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see  <http://www.gnu.org/licenses/>.
+*/
+
+#define USE_FC_LEN_T
+#include "SimplexLocator.h"
+#include <R_ext/Lapack.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+#ifndef FCONE
+# define FCONE
+#endif
+
+// Number of simplices in a leaf of the bounding volume hierarchy
+#define SIMPLEX_LEAF_SIZE 4
+
+// x is a column-major np-by-dim matrix of points and t a column-major
+// nt-by-(dim + 1) matrix of 1-based indices into the rows of x
+SimplexLocator::SimplexLocator(const double* x, const int np, const int dim, const int* t, const int nt, const double eps) :
+  dim(dim), nt(nt), EPSILON(eps)
+{
+  ref.assign((size_t)dim*nt, 0);
+  inv.assign((size_t)dim*dim*nt, 0);
+  valid.assign(nt, 0);
+
+  std::vector<double> X1(dim*dim), LU(dim*dim), work(4*dim);
+  std::vector<int> ipiv(dim), iwork(dim);
+
+  // Bounding boxes and centres of the valid simplices
+  std::vector<double> sbox((size_t)2*dim*nt);
+  std::vector<double> centre((size_t)dim*nt);
+
+  for (int k = 0 ; k < nt ; k++)
+  {
+    const int last = t[k + (size_t)nt*dim] - 1;
+
+    for (int l = 0 ; l < dim ; l++)
+      ref[(size_t)dim*k + l] = x[last + (size_t)np*l];
+
+    // X1 = X[1:N,] - X[N+1,], as in cart2bary()
+    for (int i = 0 ; i < dim ; i++)
+    {
+      const int v = t[k + (size_t)nt*i] - 1;
+      for (int l = 0 ; l < dim ; l++)
+        X1[i + dim*l] = x[v + (size_t)np*l] - ref[(size_t)dim*k + l];
+    }
+
+    // Skip simplices with rcond(X1) < .Machine$double.eps, computed
+    // as by rcond() in R
+    int info;
+    double anorm = F77_CALL(dlange)("O", &dim, &dim, X1.data(), &dim, work.data() FCONE);
+    LU = X1;
+    F77_CALL(dgetrf)(&dim, &dim, LU.data(), &dim, ipiv.data(), &info);
+    if (info != 0)
+      continue;
+    double rcond;
+    F77_CALL(dgecon)("O", &dim, LU.data(), &dim, &anorm, &rcond, work.data(), iwork.data(), &info FCONE);
+    if (info != 0 || !(rcond >= DBL_EPSILON))
+      continue;
+
+    // inv = solve(X1)
+    double *Xinv = &inv[(size_t)dim*dim*k];
+    for (int i = 0 ; i < dim ; i++)
+      Xinv[i + dim*i] = 1;
+    LU = X1;
+    F77_CALL(dgesv)(&dim, &dim, LU.data(), &dim, ipiv.data(), Xinv, &dim, &info);
+    if (info != 0)
+      continue;
+
+    valid[k] = 1;
+
+    // Bounding box, padded so that points that are within EPSILON of
+    // the simplex in barycentric coordinates are in it
+    double *b = &sbox[(size_t)2*dim*k];
+    double extent = 0;
+    for (int l = 0 ; l < dim ; l++)
+    {
+      b[2*l] = b[2*l + 1] = ref[(size_t)dim*k + l];
+      for (int i = 0 ; i < dim ; i++)
+      {
+        double c = x[t[k + (size_t)nt*i] - 1 + (size_t)np*l];
+        b[2*l] = std::min(b[2*l], c);
+        b[2*l + 1] = std::max(b[2*l + 1], c);
+      }
+      extent = std::max(extent, b[2*l + 1] - b[2*l]);
+      centre[(size_t)dim*k + l] = (b[2*l] + b[2*l + 1])/2;
+    }
+    double pad = 2*(dim + 1)*(EPSILON + 1e-12)*extent;
+    for (int l = 0 ; l < dim ; l++)
+    {
+      b[2*l] -= pad;
+      b[2*l + 1] += pad;
+    }
+  }
+
+  for (int k = 0 ; k < nt ; k++)
+    if (valid[k])
+      order.push_back(k);
+
+  if (order.empty())
+    return;
+
+  build(0, order.size(), sbox, centre);
+
+  // Store the simplices in the order of the leaves, so that the
+  // simplices in a leaf are next to each other in memory
+  std::vector<double> r((size_t)dim*order.size()), m((size_t)dim*dim*order.size());
+  for (size_t i = 0 ; i < order.size() ; i++)
+  {
+    std::copy(&ref[(size_t)dim*order[i]], &ref[(size_t)dim*order[i]] + dim, &r[(size_t)dim*i]);
+    std::copy(&inv[(size_t)dim*dim*order[i]], &inv[(size_t)dim*dim*order[i]] + dim*dim, &m[(size_t)dim*dim*i]);
+  }
+  ref.swap(r);
+  inv.swap(m);
+}
+
+// Build the node containing order[begin] ... order[end - 1], splitting
+// at the median of the centres along the axis in which they are most
+// spread out. Returns the index of the node.
+int SimplexLocator::build(const int begin, const int end, const std::vector<double>& sbox, const std::vector<double>& centre)
+{
+  int node = nodes.size();
+  nodes.push_back(Node());
+  box.resize(box.size() + 2*dim);
+
+  double *b = &box[(size_t)2*dim*node];
+  int minid = order[begin];
+  for (int l = 0 ; l < 2*dim ; l++)
+    b[l] = sbox[(size_t)2*dim*order[begin] + l];
+
+  for (int i = begin + 1 ; i < end ; i++)
+  {
+    const double *s = &sbox[(size_t)2*dim*order[i]];
+    for (int l = 0 ; l < dim ; l++)
+    {
+      b[2*l] = std::min(b[2*l], s[2*l]);
+      b[2*l + 1] = std::max(b[2*l + 1], s[2*l + 1]);
+    }
+    minid = std::min(minid, order[i]);
+  }
+
+  nodes[node].begin = begin;
+  nodes[node].end = end;
+  nodes[node].left = nodes[node].right = -1;
+  nodes[node].minid = minid;
+
+  if (end - begin <= SIMPLEX_LEAF_SIZE)
+    return node;
+
+  int axis = 0;
+  double spread = -1;
+  for (int l = 0 ; l < dim ; l++)
+  {
+    double lo = centre[(size_t)dim*order[begin] + l], hi = lo;
+    for (int i = begin + 1 ; i < end ; i++)
+    {
+      lo = std::min(lo, centre[(size_t)dim*order[i] + l]);
+      hi = std::max(hi, centre[(size_t)dim*order[i] + l]);
+    }
+    if (hi - lo > spread)
+    {
+      spread = hi - lo;
+      axis = l;
+    }
+  }
+
+  int mid = begin + (end - begin)/2;
+  std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                   [&centre, axis, this](int i, int j) {
+                     return centre[(size_t)dim*i + axis] < centre[(size_t)dim*j + axis];
+                   });
+
+  int left = build(begin, mid, sbox, centre);
+  int right = build(mid, end, sbox, centre);
+  nodes[node].left = left;
+  nodes[node].right = right;
+
+  return node;
+}
+
+// Compute the barycentric coordinates of p with respect to simplex
+// order[i] in the same way as cart2bary(), and return true if they
+// are all at least -EPSILON
+bool SimplexLocator::contains(const int i, const double* p, const int stride, double* bary) const
+{
+  const double *r = &ref[(size_t)dim*i];
+  const double *Xinv = &inv[(size_t)dim*dim*i];
+
+  long double sum = 0;
+  bool inside = true;
+
+  for (int j = 0 ; j < dim ; j++)
+  {
+    double b = 0;
+    for (int l = 0 ; l < dim ; l++)
+      b += (p[(size_t)l*stride] - r[l])*Xinv[l + dim*j];
+    bary[j] = b;
+    sum += b;
+    inside = inside && b >= -EPSILON;
+  }
+  bary[dim] = 1 - (double)sum;
+
+  return inside && bary[dim] >= -EPSILON;
+}
+
+// Return the 0-based index of the simplex with the lowest index
+// containing the point with coordinates p[0], p[stride], ...,
+// p[(dim - 1)*stride], or -1 if there is none. The barycentric
+// coordinates are written to bary[0] ... bary[dim]. work must have
+// space for dim + 1 doubles.
+int SimplexLocator::locate(const double* p, const int stride, double* bary, double* work) const
+{
+  if (nodes.empty())
+    return -1;
+
+  int best = -1;
+
+  // The tree is balanced, so its depth is at most 32
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0)
+  {
+    const Node& node = nodes[stack[--top]];
+
+    // Only simplices with lower indices than the best so far matter
+    if (best >= 0 && node.minid >= best)
+      continue;
+
+    const double *b = &box[(size_t)2*dim*(&node - &nodes[0])];
+    bool in = true;
+    for (int l = 0 ; l < dim && in ; l++)
+    {
+      double c = p[(size_t)l*stride];
+      in = c >= b[2*l] && c <= b[2*l + 1];
+    }
+    if (!in)
+      continue;
+
+    if (node.left >= 0)
+    {
+      // Visit the child that may hold the lower index first
+      if (nodes[node.left].minid < nodes[node.right].minid)
+      {
+        stack[top++] = node.right;
+        stack[top++] = node.left;
+      }
+      else
+      {
+        stack[top++] = node.left;
+        stack[top++] = node.right;
+      }
+      continue;
+    }
+
+    for (int i = node.begin ; i < node.end ; i++)
+    {
+      int k = order[i];
+      if ((best < 0 || k < best) && contains(i, p, stride, work))
+      {
+        best = k;
+        std::copy(work, work + dim + 1, bary);
+      }
+    }
+  }
+
+  return best;
+}
+
+// Order the m points xi (a column-major m-by-dim matrix) along a
+// Z-order (Morton) curve through their bounding box. Locating points
+// in this order, rather than in the order given, means that
+// consecutive points mostly visit the same nodes, which are then in
+// the cache.
+void SimplexLocator::spatial_order(const double* xi, const int m, std::vector<int>& perm) const
+{
+  perm.resize(m);
+  for (int i = 0 ; i < m ; i++)
+    perm[i] = i;
+
+  if (dim == 0 || m < 2)
+    return;
+
+  const int bits = std::max(1, std::min(21, 64/dim));
+  const int ndim = std::min(dim, 64);
+  std::vector<double> lo(ndim), scale(ndim);
+  for (int l = 0 ; l < ndim ; l++)
+  {
+    const double *c = xi + (size_t)m*l;
+    double hi = lo[l] = c[0];
+    for (int i = 1 ; i < m ; i++)
+    {
+      // Comparisons are false for NaN, which is then ignored
+      if (c[i] < lo[l]) lo[l] = c[i];
+      if (c[i] > hi) hi = c[i];
+    }
+    scale[l] = hi > lo[l] ? ((1ULL << bits) - 1)/(hi - lo[l]) : 0;
+  }
+
+  std::vector< std::pair<unsigned long long, int> > key(m);
+  std::vector<unsigned long long> q(ndim);
+  for (int i = 0 ; i < m ; i++)
+  {
+    for (int l = 0 ; l < ndim ; l++)
+    {
+      double s = (xi[i + (size_t)m*l] - lo[l])*scale[l];
+      q[l] = s >= 0 && s < (double)(1ULL << bits) ? (unsigned long long)s : 0;
+    }
+    unsigned long long code = 0;
+    for (int b = bits - 1 ; b >= 0 ; b--)
+      for (int l = 0 ; l < ndim ; l++)
+        code = (code << 1) | ((q[l] >> b) & 1);
+    key[i] = std::make_pair(code, i);
+  }
+
+  std::sort(key.begin(), key.end());
+  for (int i = 0 ; i < m ; i++)
+    perm[i] = key[i].second;
+}
@@ -0,0 +1,65 @@
+/*
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; either version 3 of the License, or (at your
+  option) any later version.
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see  <http://www.gnu.org/licenses/>.
+*/
+
+// Point location in a mesh of simplices in any number of dimensions,
+// used by tsearchn(). The barycentric coordinates are computed as in
+// cart2bary(), and, as in the original R implementation of tsearchn(),
+// a point in more than one simplex is assigned to the simplex with the
+// lowest index.
+
+#ifndef SIMPLEXLOCATOR_H
+#define SIMPLEXLOCATOR_H
+
+#include <vector>
+
+class SimplexLocator
+{
+public:
+  SimplexLocator(const double* x, const int np, const int dim, const int* t, const int nt, const double eps);
+  int locate(const double* p, const int stride, double* bary, double* work) const;
+  bool is_degenerate(const int k) const { return !valid[k]; }
+  int nsimplices() const { return nt; }
+  void spatial_order(const double* xi, const int m, std::vector<int>& perm) const;
+
+private:
+  struct Node
+  {
+    // The simplices in the node are order[begin] ... order[end - 1]
+    int begin, end;
+    // Children, or -1 for a leaf
+    int left, right;
+    // Lowest index of the simplices in the node
+    int minid;
+  };
+
+  int dim, nt;
+  double EPSILON;
+  // For simplex order[i], ref[dim*i + l] is coordinate l of its last
+  // vertex, and inv[dim*dim*i + ...] is the column-major inverse of the
+  // matrix of the other vertices relative to the last vertex
+  std::vector<double> ref;
+  std::vector<double> inv;
+  std::vector<char> valid;
+
+  // Bounding volume hierarchy of the simplices. The bounding box of
+  // node i is box[2*dim*i] ... box[2*dim*i + 2*dim - 1], with the
+  // minimum and maximum of coordinate l at 2*l and 2*l + 1
+  std::vector<Node> nodes;
+  std::vector<double> box;
+  std::vector<int> order;
+
+  int build(const int, const int, const std::vector<double>&, const std::vector<double>&);
+  bool contains(const int, const double*, const int, double*) const;
+};
+
+#endif //SIMPLEXLOCATOR_H
@@ -0,0 +1,331 @@
+/*
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; either version 3 of the License, or (at your
+  option) any later version.
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see  <http://www.gnu.org/licenses/>.
+*/
+
+#include "TriLocator.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+bool PointInTriangle(Point p0, Point p1, Point p2, Point p, Point* bary, double eps)
+{
+  double det = ((p1.y - p2.y)*(p0.x - p2.x) + (p2.x - p1.x)*(p0.y - p2.y));
+  double a = ((p1.y - p2.y)*(p.x - p2.x) + (p2.x - p1.x)*(p.y - p2.y)) / det;
+  double b = ((p2.y - p0.y)*(p.x - p2.x) + (p0.x - p2.x)*(p.y - p2.y)) / det;
+  double c = 1 - a - b;
+
+  bary->x = c;
+  bary->y = b;
+
+  return -eps <= a && a <= 1+eps && -eps <= b && b <= 1+eps && -eps <= c && c <= 1+eps;
+}
+
+TriangleMap::TriangleMap(const Point& p0, const Point& p1, const Point& p2) :
+  x2(p2.x), y2(p2.y)
+{
+  double det = ((p1.y - p2.y)*(p0.x - p2.x) + (p2.x - p1.x)*(p0.y - p2.y));
+  double idet = 1/det;
+
+  m11 = (p1.y - p2.y)*idet;
+  m12 = (p2.x - p1.x)*idet;
+  m21 = (p2.y - p0.y)*idet;
+  m22 = (p0.x - p2.x)*idet;
+}
+
+// Compute the barycentric coordinates a[i] and b[i] of the n points
+// (px[i], py[i]). The points are stored as separate arrays of x and y
+// coordinates and the loop has no branches, so that it can be
+// vectorised. The simd pragma asks for this when compiling with
+// OpenMP, since at -O2 compilers may not vectorise loops of unknown
+// length. Degenerate triangles give coordinates that are not finite,
+// as in PointInTriangle().
+void TriangleMap::map(const double* px, const double* py, const int n, double* a, double* b) const
+{
+#ifdef _OPENMP
+  #pragma omp simd
+#endif
+  for (int i = 0 ; i < n ; i++)
+  {
+    double dx = px[i] - x2;
+    double dy = py[i] - y2;
+    a[i] = m11*dx + m12*dy;
+    b[i] = m21*dx + m22*dy;
+  }
+}
+
+// elem is the triangulation as passed from R, i.e. a column-major
+// nelem-by-3 matrix of 1-based indices into x and y
+TriLocator::TriLocator(const double* x, const double* y, const int np, const int* elem, const int nelem, const double eps) :
+  np(np), nelem(nelem), EPSILON(eps)
+{
+  // Work relative to the lower left corner of the points so that
+  // triangulations far from the origin do not lose precision (see
+  // Issue #57)
+  xoffset = np > 0 ? *std::min_element(x, x + np) : 0;
+  yoffset = np > 0 ? *std::min_element(y, y + np) : 0;
+
+  vx.resize(np);
+  vy.resize(np);
+  for (int i = 0 ; i < np ; i++)
+  {
+    vx[i] = x[i] - xoffset;
+    vy[i] = y[i] - yoffset;
+  }
+
+  tri.resize(3*nelem);
+  for (int k = 0 ; k < nelem ; k++)
+    for (int j = 0 ; j < 3 ; j++)
+      tri[3*k + j] = elem[k + nelem*j] - 1;
+
+  build_neighbours();
+  build_grid();
+}
+
+// neighbours[3*k + j] is the triangle sharing the edge opposite
+// vertex j of triangle k, or -1 if the edge is on the boundary
+void TriLocator::build_neighbours()
+{
+  std::vector< std::pair<unsigned long long, int> > edges(3*nelem);
+
+  for (int k = 0 ; k < nelem ; k++)
+  {
+    for (int j = 0 ; j < 3 ; j++)
+    {
+      unsigned long long a = tri[3*k + (j + 1) % 3];
+      unsigned long long b = tri[3*k + (j + 2) % 3];
+      if (a > b) std::swap(a, b);
+      edges[3*k + j] = std::make_pair((a << 32) | b, 3*k + j);
+    }
+  }
+
+  std::sort(edges.begin(), edges.end());
+
+  neighbours.assign(3*nelem, -1);
+
+  for (unsigned int i = 0 ; i + 1 < edges.size() ; i++)
+  {
+    if (edges[i].first == edges[i + 1].first)
+    {
+      neighbours[edges[i].second] = edges[i + 1].second / 3;
+      neighbours[edges[i + 1].second] = edges[i].second / 3;
+      i++;
+    }
+  }
+}
+
+void TriLocator::build_grid()
+{
+  xmin = ymin = xmax = ymax = 0;
+
+  if (nelem == 0)
+  {
+    nx = ny = 1;
+    dx = dy = 1;
+    cell_start.assign(2, 0);
+    return;
+  }
+
+  xmin = xmax = vx[tri[0]];
+  ymin = ymax = vy[tri[0]];
+
+  for (int i = 0 ; i < 3*nelem ; i++)
+  {
+    xmin = std::min(xmin, vx[tri[i]]);
+    xmax = std::max(xmax, vx[tri[i]]);
+    ymin = std::min(ymin, vy[tri[i]]);
+    ymax = std::max(ymax, vy[tri[i]]);
+  }
+
+  // Aim for roughly one triangle per cell, with square-ish cells
+  double w = xmax - xmin > 0 ? xmax - xmin : 1;
+  double h = ymax - ymin > 0 ? ymax - ymin : 1;
+
+  double nxd = std::ceil(std::sqrt(nelem * w / h));
+  nxd = std::max(1.0, std::min(nxd, (double)nelem));
+  nx = (int)nxd;
+  ny = std::max(1, std::min(nelem, (int)std::ceil((double)nelem / nx)));
+  dx = w/nx;
+  dy = h/ny;
+
+  cell_start.assign(nx*ny + 1, 0);
+
+  // Two passes over the triangles: count the entries in each cell,
+  // then fill them in, so that each cell lists its triangles in
+  // increasing order
+
+  for (int pass = 0 ; pass < 2 ; pass++)
+  {
+    std::vector<int> next;
+
+    if (pass == 1)
+    {
+      for (int c = 0 ; c < nx*ny ; c++)
+        cell_start[c + 1] += cell_start[c];
+      cell_tri.resize(cell_start[nx*ny]);
+      next.assign(cell_start.begin(), cell_start.end() - 1);
+    }
+
+    for (int k = 0 ; k < nelem ; k++)
+    {
+      const int* v = &tri[3*k];
+      int ix0 = cell_x(std::min(vx[v[0]], std::min(vx[v[1]], vx[v[2]])) - EPSILON);
+      int ix1 = cell_x(std::max(vx[v[0]], std::max(vx[v[1]], vx[v[2]])) + EPSILON);
+      int iy0 = cell_y(std::min(vy[v[0]], std::min(vy[v[1]], vy[v[2]])) - EPSILON);
+      int iy1 = cell_y(std::max(vy[v[0]], std::max(vy[v[1]], vy[v[2]])) + EPSILON);
+
+      for (int iy = iy0 ; iy <= iy1 ; iy++)
+      {
+        for (int ix = ix0 ; ix <= ix1 ; ix++)
+        {
+          if (pass == 0)
+            cell_start[ix + nx*iy + 1]++;
+          else
+            cell_tri[next[ix + nx*iy]++] = k;
+        }
+      }
+    }
+  }
+}
+
+int TriLocator::cell_x(const double x) const
+{
+  int i = (int)std::floor((x - xmin)/dx);
+  return i < 0 ? 0 : (i >= nx ? nx - 1 : i);
+}
+
+int TriLocator::cell_y(const double y) const
+{
+  int i = (int)std::floor((y - ymin)/dy);
+  return i < 0 ? 0 : (i >= ny ? ny - 1 : i);
+}
+
+bool TriLocator::contains(const int k, const Point& p, Point* pbary) const
+{
+  const int* v = &tri[3*k];
+  Point A(vx[v[0]], vy[v[0]]);
+  Point B(vx[v[1]], vy[v[1]]);
+  Point C(vx[v[2]], vy[v[2]]);
+
+  return PointInTriangle(A, B, C, p, pbary, EPSILON);
+}
+
+// Return the 0-based index of the triangle containing (xi, yi), or -1
+// if there is none or the point is not finite. If bary is not null,
+// the barycentric coordinates of the point are written to bary[0],
+// bary[1] and bary[2].
+int TriLocator::locate(const double xi, const double yi, double* bary) const
+{
+  // NaN fails all the comparisons with the bounding box below, and
+  // could not be converted to a cell index
+  if (!std::isfinite(xi) || !std::isfinite(yi))
+    return -1;
+
+  Point p(xi - xoffset, yi - yoffset);
+
+  if (nelem == 0 ||
+      p.x < xmin - EPSILON || p.x > xmax + EPSILON ||
+      p.y < ymin - EPSILON || p.y > ymax + EPSILON)
+    return -1;
+
+  int c = cell_x(p.x) + nx*cell_y(p.y);
+
+  // Search from the end of the list so that, as in C_tsearch, a point
+  // on an edge shared by two triangles is assigned to the triangle
+  // with the higher index
+  for (int i = cell_start[c + 1] - 1 ; i >= cell_start[c] ; i--)
+  {
+    Point pbary;
+    int k = cell_tri[i];
+
+    if (contains(k, p, &pbary))
+    {
+      if (bary)
+      {
+        bary[0] = 1 - pbary.x - pbary.y;
+        bary[1] = pbary.y;
+        bary[2] = pbary.x;
+      }
+      return k;
+    }
+  }
+
+  return -1;
+}
+
+// Locate (xi, yi) by walking from triangle start across the edge
+// opposite the vertex with the most negative barycentric coordinate
+// until the triangle containing the point is reached. For spatially
+// coherent queries, e.g. points along a trajectory, starting from the
+// previous result makes this close to O(1) per point. The walk gives
+// up and falls back to locate() if start is -1, if it reaches the
+// boundary of the triangulation (which need not be convex), if it
+// takes more than WALK_MAX_STEPS steps (the point is then far away,
+// and walks can cycle in non-Delaunay triangulations) or if the point
+// lies within EPSILON of an edge, so that the results are identical
+// to those of locate().
+int TriLocator::walk(const double xi, const double yi, const int start, double* bary) const
+{
+  if (!std::isfinite(xi) || !std::isfinite(yi))
+    return -1;
+
+  if (start < 0 || start >= nelem)
+    return locate(xi, yi, bary);
+
+  Point p(xi - xoffset, yi - yoffset);
+  int k = start;
+
+  for (int step = 0 ; step < WALK_MAX_STEPS ; step++)
+  {
+    Point pbary;
+    bool inside = contains(k, p, &pbary);
+    double w[3] = {1 - pbary.x - pbary.y, pbary.y, pbary.x};
+
+    if (inside)
+    {
+      // Points near an edge may also be in a neighbouring triangle
+      // with a higher index, which locate() would return instead
+      bool ambiguous = !(w[0] > EPSILON && w[1] > EPSILON && w[2] > EPSILON);
+      for (int j = 0 ; j < 3 && !ambiguous ; j++)
+      {
+        Point nbary;
+        int n = neighbours[3*k + j];
+        ambiguous = n > k && contains(n, p, &nbary);
+      }
+
+      if (!ambiguous)
+      {
+        if (bary)
+        {
+          bary[0] = w[0];
+          bary[1] = w[1];
+          bary[2] = w[2];
+        }
+        return k;
+      }
+      break;
+    }
+
+    // Degenerate triangles give NaN coordinates
+    if (!(w[0] == w[0] && w[1] == w[1] && w[2] == w[2]))
+      break;
+
+    int j = 0;
+    if (w[1] < w[j]) j = 1;
+    if (w[2] < w[j]) j = 2;
+
+    k = neighbours[3*k + j];
+    if (k < 0)
+      break;
+  }
+
+  return locate(xi, yi, bary);
+}
@@ -0,0 +1,75 @@
+/*
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the
+  Free Software Foundation; either version 3 of the License, or (at your
+  option) any later version.
+  This program is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see  <http://www.gnu.org/licenses/>.
+*/
+
+// Persistent point location structure for a 2D triangulation, built
+// once from (x, y, tri) and queried many times by tsearch.locate().
+
+#ifndef TRILOCATOR_H
+#define TRILOCATOR_H
+
+#include <vector>
+#include "QuadTree.h"
+
+#define WALK_MAX_STEPS 8
+
+bool PointInTriangle(Point p0, Point p1, Point p2, Point p, Point* bary, double eps);
+
+// Number of points mapped by one call of TriangleMap::map() in tsearch
+#define TRIANGLE_MAP_BLOCK 256
+
+// The affine map from the plane to the barycentric coordinates (a, b)
+// of triangle p0 p1 p2 used by PointInTriangle(), with the determinant
+// inverted once so that the coordinates of many points can be
+// computed without divisions
+struct TriangleMap
+{
+  double x2, y2;
+  double m11, m12, m21, m22;
+
+  TriangleMap(const Point&, const Point&, const Point&);
+  void map(const double*, const double*, const int, double*, double*) const;
+};
+
+class TriLocator
+{
+public:
+  TriLocator(const double* x, const double* y, const int np, const int* elem, const int nelem, const double eps);
+  int locate(const double xi, const double yi, double* bary) const;
+  int walk(const double xi, const double yi, const int start, double* bary) const;
+  int ntriangles() const { return nelem; }
+  int neighbour(const int k, const int j) const { return neighbours[3*k + j]; }
+
+private:
+  int np, nelem;
+  double EPSILON;
+  double xoffset, yoffset;
+  std::vector<double> vx, vy;
+  std::vector<int> tri;
+  std::vector<int> neighbours;
+
+  // Uniform grid of buckets over the triangle bounding boxes, stored
+  // in compressed form: triangles overlapping cell c are
+  // cell_tri[cell_start[c]] ... cell_tri[cell_start[c + 1] - 1]
+  int nx, ny;
+  double xmin, ymin, xmax, ymax, dx, dy;
+  std::vector<int> cell_start;
+  std::vector<int> cell_tri;
+
+  void build_neighbours();
+  void build_grid();
+  int cell_x(const double) const;
+  int cell_y(const double) const;
+  bool contains(const int, const Point&, Point*) const;
+};
+
+#endif //TRILOCATOR_H
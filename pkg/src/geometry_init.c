@@ -8,22 +8,56 @@
 */
 
 /* .Call calls */
-extern SEXP _geometry_C_tsearch(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP C_convhulln(SEXP, SEXP, SEXP, SEXP, SEXP);
-extern SEXP C_delaunayn(SEXP, SEXP, SEXP, SEXP);
-extern SEXP C_halfspacen(SEXP, SEXP, SEXP, SEXP);
+extern SEXP _geometry_C_tsearch(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _geometry_C_tsearch_locator(SEXP, SEXP, SEXP, SEXP);
+extern SEXP _geometry_C_tsearch_locate(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _geometry_C_tsearch_locate_file(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _geometry_C_tsearchn_simplex(SEXP, SEXP, SEXP);
+extern SEXP C_convhulln(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_convhulln_batch(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_convhulln_bvh(SEXP, SEXP);
+extern SEXP C_convhulln_incremental(SEXP, SEXP);
+extern SEXP C_convhulln_incremental_add(SEXP, SEXP);
+extern SEXP C_convhulln_incremental_hull(SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_convhulln_index(SEXP);
+extern SEXP C_delaunayn(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_delaunayn_batch(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_delaunayn_kd(SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_halfspacen(SEXP, SEXP);
 extern SEXP C_inhulln(SEXP, SEXP);
+extern SEXP C_inhulln_bvh(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_inhulln_distance(SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_inhulln_index(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_inhulln_scan(SEXP, SEXP, SEXP, SEXP);
+extern SEXP C_qhull_memory(SEXP);
 extern SEXP C_tsearch_orig(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP C_tsearchn(SEXP, SEXP);
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_geometry_C_tsearch", (DL_FUNC) &_geometry_C_tsearch, 7},
-    {"C_convhulln",         (DL_FUNC) &C_convhulln,         5},
-    {"C_delaunayn",         (DL_FUNC) &C_delaunayn,         4},
-    {"C_halfspacen",        (DL_FUNC) &C_halfspacen,        4},
-    {"C_inhulln",           (DL_FUNC) &C_inhulln,           2},
-    {"C_tsearch_orig",      (DL_FUNC) &C_tsearch_orig,      6},
-    {"C_tsearchn",          (DL_FUNC) &C_tsearchn,          2},
+    {"_geometry_C_tsearch",             (DL_FUNC) &_geometry_C_tsearch,             10},
+    {"_geometry_C_tsearch_locator",     (DL_FUNC) &_geometry_C_tsearch_locator,     4},
+    {"_geometry_C_tsearch_locate",      (DL_FUNC) &_geometry_C_tsearch_locate,      6},
+    {"_geometry_C_tsearch_locate_file", (DL_FUNC) &_geometry_C_tsearch_locate_file, 7},
+    {"_geometry_C_tsearchn_simplex",    (DL_FUNC) &_geometry_C_tsearchn_simplex,    3},
+    {"C_convhulln",                     (DL_FUNC) &C_convhulln,                     6},
+    {"C_convhulln_batch",               (DL_FUNC) &C_convhulln_batch,               5},
+    {"C_convhulln_bvh",                 (DL_FUNC) &C_convhulln_bvh,                 2},
+    {"C_convhulln_incremental",         (DL_FUNC) &C_convhulln_incremental,         2},
+    {"C_convhulln_incremental_add",     (DL_FUNC) &C_convhulln_incremental_add,     2},
+    {"C_convhulln_incremental_hull",    (DL_FUNC) &C_convhulln_incremental_hull,    4},
+    {"C_convhulln_index",               (DL_FUNC) &C_convhulln_index,               1},
+    {"C_delaunayn",                     (DL_FUNC) &C_delaunayn,                     6},
+    {"C_delaunayn_batch",               (DL_FUNC) &C_delaunayn_batch,               5},
+    {"C_delaunayn_kd",                  (DL_FUNC) &C_delaunayn_kd,                  4},
+    {"C_halfspacen",                    (DL_FUNC) &C_halfspacen,                    2},
+    {"C_inhulln",                       (DL_FUNC) &C_inhulln,                       2},
+    {"C_inhulln_bvh",                   (DL_FUNC) &C_inhulln_bvh,                   6},
+    {"C_inhulln_distance",              (DL_FUNC) &C_inhulln_distance,              4},
+    {"C_inhulln_index",                 (DL_FUNC) &C_inhulln_index,                 5},
+    {"C_inhulln_scan",                  (DL_FUNC) &C_inhulln_scan,                  4},
+    {"C_qhull_memory",                  (DL_FUNC) &C_qhull_memory,                  1},
+    {"C_tsearch_orig",                  (DL_FUNC) &C_tsearch_orig,                  6},
+    {"C_tsearchn",                      (DL_FUNC) &C_tsearchn,                      2},
     {NULL, NULL, 0}
 };
 
@@ -129,6 +129,7 @@ int qh_new_qhull(qhT *qh, int dim, int numpoints, coordT *points, boolT ismalloc
   int exitcode, hulldim;
   boolT new_ismalloc;
   coordT *new_points;
+  void *cpp_user;
 
   if(!errfile){
     errfile= stderr;
@@ -142,7 +143,13 @@ int qh_new_qhull(qhT *qh, int dim, int numpoints, coordT *points, boolT ismalloc
     qh_fprintf(qh, errfile, 6186, "qhull error (qh_new_qhull): start qhull_cmd argument with \"qhull \" or set to \"qhull\"\n");
     return qh_ERRinput;
   }
+  /* CHANGE TO SOURCE: qh_initqhull_start() clears qh, but
+     qh->cpp_user is the buffer for error output (see qh_fprintf() in
+     userprintf_r.c), so keep it */
+  cpp_user= qh->cpp_user;
   qh_initqhull_start(qh, NULL, outfile, errfile);
+  qh->cpp_user= cpp_user;
+  /* CHANGE TO SOURCE */
   if(numpoints==0 && points==NULL){
       trace1((qh, qh->ferr, 1047, "qh_new_qhull: initialize Qhull\n"));
       return 0;
@@ -26,6 +26,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*-<a                             href="qh-user_r.htm#TOC"
   >-------------------------------</a><a name="qh_fprintf">-</a>
@@ -46,6 +47,37 @@ void qh_fprintf(qhT *qh, FILE *fp, int msgcode, const char *fmt, ... ) {
   va_list args;
   facetT *neighbor, **neighborp;
 
+  /* CHANGE TO SOURCE: R packages cannot write to stderr, so output
+     to the fake stderr qh_FILEstderr is appended to the string
+     qh->cpp_user, which has space for ERRSTRSIZE characters, if it
+     is set, and otherwise printed with REprintf(). */
+  if (fp == qh_FILEstderr) {
+    char *buf = qh ? (char *) qh->cpp_user : NULL;
+    size_t len = buf ? strlen(buf) : 0;
+    va_start(args, fmt);
+    if (buf) {
+      if ((qh && qh->ANNOTATEoutput) || msgcode < MSG_TRACE4) {
+        snprintf(buf + len, ERRSTRSIZE - len, "[QH%.4d]", msgcode);
+      }else if (msgcode >= MSG_ERROR && msgcode < MSG_STDERR ) {
+        snprintf(buf + len, ERRSTRSIZE - len, "QH%.4d ", msgcode);
+      }
+      len = strlen(buf);
+      vsnprintf(buf + len, ERRSTRSIZE - len, fmt, args);
+    } else {
+      if ((qh && qh->ANNOTATEoutput) || msgcode < MSG_TRACE4) {
+        REprintf("[QH%.4d]", msgcode);
+      }else if (msgcode >= MSG_ERROR && msgcode < MSG_STDERR ) {
+        REprintf("QH%.4d ", msgcode);
+      }
+      REvprintf(fmt, args);
+    }
+    va_end(args);
+    if (qh && msgcode >= MSG_ERROR && msgcode < MSG_WARNING)
+      qh->last_errcode= msgcode;
+    return;
+  }
+  /* CHANGE TO SOURCE */
+
   if (!fp) {
     if(!qh){
       qh_fprintf_stderr(6241, "qhull internal error (userprintf_r.c): fp and qh not defined for qh_fprintf '%s'\n", fmt);